@@ -22,6 +22,16 @@ int main() {
     scvThreshold(image, imageBin, SCV_GRAYING_W_AVG);
     scvSaveImage(imageBin, IMAGES_DIR "bin.bmp");
 
+    // Test connected components
+    ScvLabels *labels = scvCreateLabels(scvGetSize(imageBin));
+    scvConnectedComponents(imageBin, labels, 8, 4);
+    scvReleaseLabels(labels);
+
+    // Test morphology
+    ScvImage *imageOpened = scvCreateImage(scvGetSize(image));
+    scvMorphology(imageBin, imageOpened, SCV_MORPH_OPEN, scvSize(15, 15));
+    scvSaveImage(imageOpened, IMAGES_DIR "opened.bmp");
+
     // Test split
     ScvImage *b = scvCreateImage(scvGetSize(image));
     ScvImage *g = scvCreateImage(scvGetSize(image));
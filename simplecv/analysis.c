@@ -0,0 +1,889 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <limits.h>
+#include <math.h>
+#include <memory.h>
+#include <stdlib.h>
+
+#include "analysis.h"
+#include "core.h"
+#include "fft.h"
+
+#pragma mark - Inner
+
+#define MIN(val1, val2) ((val1) > (val2) ? (val2) : (val1))
+#define MAX(val1, val2) ((val1) > (val2) ? (val1) : (val2))
+#define PI 3.14159265
+
+typedef struct _ComponentAccumulator {
+    int area;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    long long sumX;
+    long long sumY;
+} ComponentAccumulator;
+
+/**
+ * Provisional labels are kept in a union-find forest,
+ * the root of a set is always its smallest label.
+ */
+int findRootLabel(const int *parent, int i) {
+    while (parent[i] < i) {
+        i = parent[i];
+    }
+    return i;
+}
+
+void setRootLabel(int *parent, int i, int root) {
+    while (parent[i] < i) {
+        int j = parent[i];
+        parent[i] = root;
+        i = j;
+    }
+    parent[i] = root;
+}
+
+int unionLabels(int *parent, int i, int j) {
+    int root = findRootLabel(parent, i);
+    if (i != j) {
+        int rootJ = findRootLabel(parent, j);
+        if (root > rootJ) {
+            root = rootJ;
+        }
+        setRootLabel(parent, j, root);
+    }
+    setRootLabel(parent, i, root);
+    return root;
+}
+
+int connectLabel(int *parent, int label, int neighbor) { return label ? unionLabels(parent, label, neighbor) : neighbor; }
+
+int newLabel(int *parent, int *next) {
+    parent[*next] = *next;
+    return (*next)++;
+}
+
+/**
+ * Scan pixel rows [y0, y1) with 4-connectivity, the row above y0 belongs to another strip.
+ */
+void scanStrip4(const ScvImage *image, int *label, int *parent, int y0, int y1, int *next) {
+    const int w = image->width;
+    for (int y = y0; y < y1; y++) {
+        const ScvPixel *row = scvGetRowRef(image, y);
+        int *cur = label + y * w;
+        const int *up = y > y0 ? cur - w : NULL;
+        for (int x = 0; x < w; x++) {
+            if (0 == row[x].r) {
+                cur[x] = 0;
+                continue;
+            }
+
+            int l = x > 0 ? cur[x - 1] : 0;
+            if (NULL != up && up[x]) {
+                l = connectLabel(parent, l, up[x]);
+            }
+            cur[x] = l ? l : newLabel(parent, next);
+        }
+    }
+}
+
+/**
+ * Bits of the 2x2 block mask:
+ *     [ 1 2 ]
+ *     [ 4 8 ]
+ * All foreground pixels inside a block are 8-connected, so a block needs only one label.
+ * Merges the block at idx with the blocks above it that it touches, and returns the merged label.
+ */
+int connectBlocks(int *parent, const ScvUByte *mask, const int *block, int bw, int idx, int bx, int l) {
+    const int m = mask[idx];
+    if (bx > 0 && (m & 1) && (mask[idx - bw - 1] & 8)) {
+        l = connectLabel(parent, l, block[idx - bw - 1]);
+    }
+    if ((m & 3) && (mask[idx - bw] & 12)) {
+        l = connectLabel(parent, l, block[idx - bw]);
+    }
+    if (bx + 1 < bw && (m & 2) && (mask[idx - bw + 1] & 4)) {
+        l = connectLabel(parent, l, block[idx - bw + 1]);
+    }
+    return l;
+}
+
+/**
+ * Scan block rows [by0, by1) with 8-connectivity, the block row above by0 belongs to another strip.
+ */
+void scanStrip8(const ScvImage *image, ScvUByte *mask, int *block, int *parent, int by0, int by1, int *next) {
+    const int w = image->width;
+    const int bw = (w + 1) / 2;
+    for (int by = by0; by < by1; by++) {
+        const ScvPixel *r0 = scvGetRowRef(image, by * 2);
+        const ScvPixel *r1 = scvGetRowRef(image, by * 2 + 1);
+        for (int bx = 0, x = 0; bx < bw; bx++, x += 2) {
+            const int idx = by * bw + bx;
+            const int hasRight = x + 1 < w;
+            int m = (r0[x].r ? 1 : 0) | (hasRight && r0[x + 1].r ? 2 : 0);
+            if (NULL != r1) {
+                m |= (r1[x].r ? 4 : 0) | (hasRight && r1[x + 1].r ? 8 : 0);
+            }
+            mask[idx] = (ScvUByte)m;
+            if (0 == m) {
+                block[idx] = 0;
+                continue;
+            }
+
+            int l = 0;
+            if (bx > 0 && (m & 5) && (mask[idx - 1] & 10)) {
+                l = block[idx - 1];
+            }
+            if (by > by0) {
+                l = connectBlocks(parent, mask, block, bw, idx, bx, l);
+            }
+            block[idx] = l ? l : newLabel(parent, next);
+        }
+    }
+}
+
+void accumulateComponent(ComponentAccumulator *acc, int x, int y) {
+    acc->area++;
+    acc->sumX += x;
+    acc->sumY += y;
+    acc->minX = x < acc->minX ? x : acc->minX;
+    acc->maxX = x > acc->maxX ? x : acc->maxX;
+    acc->minY = y < acc->minY ? y : acc->minY;
+    acc->maxY = y > acc->maxY ? y : acc->maxY;
+}
+
+/**
+ * Hough transform shares the setup of the standard and the probabilistic versions:
+ * edge pixels are collected into a point list first, and the trig tables are scaled by 1 / rho step
+ * so that a vote is one multiply-add per angle.
+ */
+typedef struct _HoughSpace {
+    int numAngle;
+    int numRho;
+    float *tabCos;
+    float *tabSin;
+    int *points; // x, y pairs
+    int pointCount;
+} HoughSpace;
+
+ScvBool createHoughSpace(const ScvImage *edges, float rhoStep, float thetaStep, HoughSpace *space) {
+    const int w = edges->width;
+    const int h = edges->height;
+    if (rhoStep <= 0.0f || thetaStep <= 0.0f || w <= 0 || h <= 0 || SCV_DEPTH_8U != edges->depth) {
+        return SCV_FALSE;
+    }
+
+    space->numAngle = MAX((int)(PI / thetaStep + 0.5f), 1);
+    space->numRho = (int)(((w + h) * 2 + 1) / rhoStep + 0.5f);
+    space->tabCos = (float *)malloc(sizeof(float) * space->numAngle * 2);
+    space->tabSin = space->tabCos + space->numAngle;
+    for (int n = 0; n < space->numAngle; n++) {
+        space->tabCos[n] = (float)(cos(n * (double)thetaStep) / rhoStep);
+        space->tabSin[n] = (float)(sin(n * (double)thetaStep) / rhoStep);
+    }
+
+    space->points = (int *)malloc(sizeof(int) * 2 * w * h);
+    space->pointCount = 0;
+    for (int y = 0; y < h; y++) {
+        const ScvPixel *row = scvGetRowRef(edges, y);
+        for (int x = 0; x < w; x++) {
+            if (0 != row[x].r) {
+                space->points[space->pointCount * 2] = x;
+                space->points[space->pointCount * 2 + 1] = y;
+                space->pointCount++;
+            }
+        }
+    }
+    return SCV_TRUE;
+}
+
+void releaseHoughSpace(HoughSpace *space) {
+    free(space->tabCos);
+    free(space->points);
+}
+
+SCV_INLINE int houghRho(const HoughSpace *space, int n, int x, int y) {
+    return (int)lrintf(x * space->tabCos[n] + y * space->tabSin[n]) + (space->numRho - 1) / 2;
+}
+
+typedef struct _HoughCandidate {
+    int votes;
+    int index;
+} HoughCandidate;
+
+int compareHoughCandidate(const void *a, const void *b) {
+    const HoughCandidate *l = (const HoughCandidate *)a;
+    const HoughCandidate *r = (const HoughCandidate *)b;
+    if (l->votes != r->votes) {
+        return r->votes - l->votes;
+    }
+    return l->index - r->index;
+}
+
+/**
+ * Minimal xorshift generator, so that the probabilistic transform is reproducible.
+ */
+unsigned int nextRandom(unsigned int *state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Half size of the search window around the upscaled match of the coarser level
+#define MATCH_REFINE_RADIUS 2
+// Pyramid levels stop before the template gets smaller than this
+#define MATCH_MIN_TEMPLATE 8
+
+/**
+ * Template matching works on gray planes, ScvMat of the red channel like scvCanny.
+ */
+ScvMat *grayMatOf(const ScvImage *image) {
+    ScvMat *mat = scvCreateMat(image->height, image->width);
+    for (int y = 0; y < image->height; y++) {
+        const ScvPixel *row = scvGetRowRef(image, y);
+        for (int x = 0; x < image->width; x++) {
+            mat->data[y * image->width + x] = row[x].r;
+        }
+    }
+    return mat;
+}
+
+// 2x2 box average, odd last rows and columns are dropped
+ScvMat *halveMat(const ScvMat *mat) {
+    const int rows = mat->rows / 2;
+    const int cols = mat->cols / 2;
+    ScvMat *result = scvCreateMat(rows, cols);
+    for (int y = 0; y < rows; y++) {
+        const float *a = mat->data + y * 2 * mat->cols;
+        const float *b = a + mat->cols;
+        for (int x = 0; x < cols; x++) {
+            result->data[y * cols + x] = (a[x * 2] + a[x * 2 + 1] + b[x * 2] + b[x * 2 + 1]) * 0.25f;
+        }
+    }
+    return result;
+}
+
+/**
+ * Summed-area tables of the values and their squares, (rows + 1) * (cols + 1) with a zero first row and column.
+ */
+typedef struct _MatchIntegrals {
+    int stride;
+    double *sum;
+    double *sqSum;
+} MatchIntegrals;
+
+MatchIntegrals createMatchIntegrals(const ScvMat *mat) {
+    MatchIntegrals integrals;
+    integrals.stride = mat->cols + 1;
+    const size_t size = (size_t)(mat->rows + 1) * integrals.stride;
+    integrals.sum = (double *)calloc(size * 2, sizeof(double));
+    integrals.sqSum = integrals.sum + size;
+    for (int y = 0; y < mat->rows; y++) {
+        double rowSum = 0.0, rowSqSum = 0.0;
+        for (int x = 0; x < mat->cols; x++) {
+            const double v = mat->data[y * mat->cols + x];
+            rowSum += v;
+            rowSqSum += v * v;
+            const int i = (y + 1) * integrals.stride + x + 1;
+            integrals.sum[i] = integrals.sum[i - integrals.stride] + rowSum;
+            integrals.sqSum[i] = integrals.sqSum[i - integrals.stride] + rowSqSum;
+        }
+    }
+    return integrals;
+}
+
+SCV_INLINE double windowSum(const double *table, int stride, int x, int y, int w, int h) {
+    return table[(y + h) * stride + x + w] - table[y * stride + x + w] - table[(y + h) * stride + x]
+           + table[y * stride + x];
+}
+
+/**
+ * Cross-correlation of the template at positions (x0 ~ x0 + cols - 1, y0 ~ y0 + rows - 1), directly.
+ * Template rows are applied as multiply-adds over whole output rows, which vectorizes.
+ */
+void crossCorrelateDirect(const ScvMat *image, const ScvMat *templ, int x0, int y0, int cols, int rows, float *out) {
+    memset(out, 0, sizeof(float) * cols * rows);
+    for (int y = 0; y < rows; y++) {
+        float *dst = out + y * cols;
+        for (int ty = 0; ty < templ->rows; ty++) {
+            const float *src = image->data + (y0 + y + ty) * image->cols + x0;
+            const float *t = templ->data + ty * templ->cols;
+            for (int tx = 0; tx < templ->cols; tx++) {
+                const float c = t[tx];
+                for (int x = 0; x < cols; x++) {
+                    dst[x] += c * src[x + tx];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Cross-correlation at every position, IFFT(FFT(image) * conj(FFT(template))),
+ * the transform size covers the image so circular wrapping never reaches a valid position.
+ */
+void crossCorrelateFFT(const ScvMat *image, const ScvMat *templ, float *out) {
+    const int rows = scvGetOptimalFFTSize(image->rows);
+    const int cols = scvGetOptimalFFTSize(image->cols);
+    const int outRows = image->rows - templ->rows + 1;
+    const int outCols = image->cols - templ->cols + 1;
+
+    ScvFFTPlan *plan = scvCreateFFTPlan(rows, cols);
+    ScvMat *values = scvCreateMat(rows, cols);
+    ScvMat *spectrum = scvCreateMat(rows, plan->specCols * 2);
+    ScvMat *templSpectrum = scvCreateMat(rows, plan->specCols * 2);
+
+    memset(values->data, 0, sizeof(float) * rows * cols);
+    for (int y = 0; y < templ->rows; y++) {
+        memcpy(values->data + y * cols, templ->data + y * templ->cols, sizeof(float) * templ->cols);
+    }
+    scvFFT(plan, values, templSpectrum);
+
+    memset(values->data, 0, sizeof(float) * rows * cols);
+    for (int y = 0; y < image->rows; y++) {
+        memcpy(values->data + y * cols, image->data + y * image->cols, sizeof(float) * image->cols);
+    }
+    scvFFT(plan, values, spectrum);
+
+    scvMulSpectrums(spectrum, templSpectrum, spectrum, SCV_TRUE);
+    scvInverseFFT(plan, spectrum, values);
+    for (int y = 0; y < outRows; y++) {
+        memcpy(out + y * outCols, values->data + y * cols, sizeof(float) * outCols);
+    }
+
+    scvReleaseMat(values);
+    scvReleaseMat(spectrum);
+    scvReleaseMat(templSpectrum);
+    scvReleaseFFTPlan(plan);
+}
+
+/**
+ * Turns the cross-correlation of a block of positions into scores, using the window energies
+ * of the image from its integrals and the template statistics.
+ */
+void scoreMatches(const MatchIntegrals *integrals, const ScvMat *templ, SCV_MATCH_TYPE type, int x0, int y0,
+                  int cols, int rows, float *values) {
+    const int tw = templ->cols;
+    const int th = templ->rows;
+    const double n = (double)tw * th;
+    double tSum = 0.0, tSqSum = 0.0;
+    for (int i = 0; i < tw * th; i++) {
+        tSum += templ->data[i];
+        tSqSum += (double)templ->data[i] * templ->data[i];
+    }
+    const double tVar = tSqSum - tSum * tSum / n;
+
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < cols; x++) {
+            float *v = values + y * cols + x;
+            const double cross = *v;
+            const double sqSum = windowSum(integrals->sqSum, integrals->stride, x0 + x, y0 + y, tw, th);
+            if (SCV_MATCH_SSD == type) {
+                *v = (float)MAX(sqSum - 2.0 * cross + tSqSum, 0.0);
+            } else {
+                const double sum = windowSum(integrals->sum, integrals->stride, x0 + x, y0 + y, tw, th);
+                const double var = sqSum - sum * sum / n;
+                const double denominator = sqrt(MAX(var, 0.0) * MAX(tVar, 0.0));
+                *v = denominator > 1e-6 ? (float)((cross - sum * tSum / n) / denominator) : 0.0f;
+            }
+        }
+    }
+}
+
+/**
+ * Scores of every position, the cross-correlation is done directly or through FFT, whichever is cheaper.
+ */
+void matchMat(const ScvMat *image, const ScvMat *templ, SCV_MATCH_TYPE type, const MatchIntegrals *integrals,
+              float *out) {
+    const int outRows = image->rows - templ->rows + 1;
+    const int outCols = image->cols - templ->cols + 1;
+    const double fftRows = scvGetOptimalFFTSize(image->rows);
+    const double fftCols = scvGetOptimalFFTSize(image->cols);
+    const double directCost = (double)outRows * outCols * templ->rows * templ->cols;
+    const double fftCost = 3.0 * 4.0 * fftRows * fftCols * log2(fftRows * fftCols);
+    if (directCost <= fftCost) {
+        crossCorrelateDirect(image, templ, 0, 0, outCols, outRows, out);
+    } else {
+        crossCorrelateFFT(image, templ, out);
+    }
+    scoreMatches(integrals, templ, type, 0, 0, outCols, outRows, out);
+}
+
+/**
+ * Best of count scores, the lowest for SSD and the highest for NCC.
+ */
+int bestMatch(const float *values, int count, SCV_MATCH_TYPE type) {
+    int best = 0;
+    for (int i = 1; i < count; i++) {
+        if (SCV_MATCH_SSD == type ? values[i] < values[best] : values[i] > values[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+#pragma mark - Export
+
+#pragma mark-- Make
+
+ScvLabels *scvCreateLabels(ScvSize size) {
+    ScvLabels *labels = (ScvLabels *)malloc(sizeof(ScvLabels));
+    labels->width = size.width;
+    labels->height = size.height;
+    labels->label = (int *)malloc(size.width * size.height * sizeof(int));
+    memset(labels->label, 0, size.width * size.height * sizeof(int));
+    labels->count = 0;
+    labels->capacity = 16;
+    labels->components = (ScvComponent *)malloc(labels->capacity * sizeof(ScvComponent));
+    memset(labels->components, 0, labels->capacity * sizeof(ScvComponent));
+    return labels;
+}
+
+void scvReleaseLabels(ScvLabels *labels) {
+    free(labels->label);
+    free(labels->components);
+    free(labels);
+}
+
+#pragma mark-- Connected Components
+
+int scvConnectedComponents(const ScvImage *image, ScvLabels *labels, int connectivity, int strips) {
+    // Two-pass union-find labeling, see Wu et al., "Optimizing two-pass connected-component labeling algorithms"
+    const int w = image->width;
+    const int h = image->height;
+    if (labels->width != w || labels->height != h || (4 != connectivity && 8 != connectivity)
+        || SCV_DEPTH_8U != image->depth) {
+        return 0;
+    }
+
+    // 4-connectivity labels pixels, 8-connectivity labels 2x2 blocks
+    const int block8 = 8 == connectivity;
+    const int bw = (w + 1) / 2;
+    const int bh = (h + 1) / 2;
+    const int units = block8 ? bw : w; // Labeling units per row
+    const int rows = block8 ? bh : h; // Rows of labeling units
+
+    strips = MAX(1, MIN(strips, rows));
+    int *stripStart = (int *)malloc((strips + 1) * sizeof(int));
+    int *stripNext = (int *)malloc(strips * sizeof(int));
+    for (int s = 0; s <= strips; s++) {
+        stripStart[s] = (int)((long long)rows * s / strips);
+    }
+
+    // Each strip owns the label range starting from the index of its first unit, so no locking is needed
+    int *parent = (int *)malloc(((size_t)units * rows + 1) * sizeof(int));
+    int *block = block8 ? (int *)malloc((size_t)bw * bh * sizeof(int)) : NULL;
+    ScvUByte *mask = block8 ? (ScvUByte *)malloc((size_t)bw * bh) : NULL;
+    parent[0] = 0;
+
+    int s;
+#pragma omp parallel for schedule(static)
+    for (s = 0; s < strips; s++) {
+        stripNext[s] = stripStart[s] * units + 1;
+        if (block8) {
+            scanStrip8(image, mask, block, parent, stripStart[s], stripStart[s + 1], &stripNext[s]);
+        } else {
+            scanStrip4(image, labels->label, parent, stripStart[s], stripStart[s + 1], &stripNext[s]);
+        }
+    }
+
+    // Merge along strip boundaries
+    for (s = 1; s < strips; s++) {
+        const int r = stripStart[s];
+        for (int x = 0; x < units; x++) {
+            if (block8) {
+                const int idx = r * bw + x;
+                if (block[idx]) {
+                    connectBlocks(parent, mask, block, bw, idx, x, block[idx]);
+                }
+            } else {
+                const int *cur = labels->label + r * w;
+                if (cur[x] && cur[x - w]) {
+                    unionLabels(parent, cur[x], cur[x - w]);
+                }
+            }
+        }
+    }
+
+    // Flatten to consecutive final labels, parent[i] < i holds so parents are resolved before children
+    int count = 1;
+    for (s = 0; s < strips; s++) {
+        for (int i = stripStart[s] * units + 1; i < stripNext[s]; i++) {
+            parent[i] = parent[i] < i ? parent[parent[i]] : count++;
+        }
+    }
+
+    if (count > labels->capacity) {
+        labels->capacity = count;
+        labels->components = (ScvComponent *)realloc(labels->components, count * sizeof(ScvComponent));
+    }
+    labels->count = count - 1;
+
+    // Second pass, write final labels and gather statistics per strip
+    ComponentAccumulator *acc = (ComponentAccumulator *)malloc((size_t)strips * count * sizeof(ComponentAccumulator));
+    for (int i = 0; i < strips * count; i++) {
+        acc[i].area = 0;
+        acc[i].sumX = acc[i].sumY = 0;
+        acc[i].minX = acc[i].minY = INT_MAX;
+        acc[i].maxX = acc[i].maxY = -1;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (s = 0; s < strips; s++) {
+        ComponentAccumulator *stripAcc = acc + s * count;
+        const int y0 = block8 ? stripStart[s] * 2 : stripStart[s];
+        const int y1 = block8 ? MIN(stripStart[s + 1] * 2, h) : stripStart[s + 1];
+        for (int y = y0; y < y1; y++) {
+            const ScvPixel *row = scvGetRowRef(image, y);
+            const int *blockRow = block8 ? block + (y >> 1) * bw : NULL;
+            int *out = labels->label + y * w;
+            for (int x = 0; x < w; x++) {
+                int l;
+                if (block8) {
+                    l = row[x].r ? parent[blockRow[x >> 1]] : 0;
+                } else {
+                    l = parent[out[x]];
+                }
+                out[x] = l;
+                accumulateComponent(stripAcc + l, x, y);
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        ComponentAccumulator total = acc[i];
+        for (s = 1; s < strips; s++) {
+            const ComponentAccumulator *cur = acc + s * count + i;
+            total.area += cur->area;
+            total.sumX += cur->sumX;
+            total.sumY += cur->sumY;
+            total.minX = MIN(total.minX, cur->minX);
+            total.minY = MIN(total.minY, cur->minY);
+            total.maxX = MAX(total.maxX, cur->maxX);
+            total.maxY = MAX(total.maxY, cur->maxY);
+        }
+
+        ScvComponent *comp = labels->components + i;
+        comp->area = total.area;
+        if (total.area > 0) {
+            comp->bound = scvRect(total.minX, total.minY, total.maxX - total.minX + 1, total.maxY - total.minY + 1);
+            comp->cx = (float)total.sumX / total.area;
+            comp->cy = (float)total.sumY / total.area;
+        } else {
+            comp->bound = scvRect(0, 0, 0, 0);
+            comp->cx = comp->cy = 0;
+        }
+    }
+
+    free(acc);
+    free(stripStart);
+    free(stripNext);
+    free(parent);
+    free(block);
+    free(mask);
+    return labels->count;
+}
+
+#pragma mark-- Hough Lines
+
+int scvHoughLines(const ScvImage *edges, float rhoStep, float thetaStep, int threshold, ScvLine *lines, int maxLines) {
+    HoughSpace space;
+    if (maxLines <= 0 || !createHoughSpace(edges, rhoStep, thetaStep, &space)) {
+        return 0;
+    }
+
+    // The accumulator has a border of zeros around it, rows are angles, columns are distances
+    const int numAngle = space.numAngle;
+    const int numRho = space.numRho;
+    const int stride = numRho + 2;
+    const size_t accSize = (size_t)(numAngle + 2) * stride;
+    int *acc = (int *)calloc(accSize, sizeof(int));
+
+    // Every thread votes into its own accumulator, which is added to the shared one at the end
+#pragma omp parallel
+    {
+        int *local = (int *)calloc(accSize, sizeof(int));
+        int i;
+#pragma omp for schedule(static)
+        for (i = 0; i < space.pointCount; i++) {
+            const int x = space.points[i * 2];
+            const int y = space.points[i * 2 + 1];
+            for (int n = 0; n < numAngle; n++) {
+                local[(n + 1) * stride + houghRho(&space, n, x, y) + 1]++;
+            }
+        }
+#pragma omp critical
+        {
+            for (size_t k = 0; k < accSize; k++) {
+                acc[k] += local[k];
+            }
+        }
+        free(local);
+    }
+
+    // Non-maximum suppression over the 4 neighbours, ties go to the first bin
+    HoughCandidate *candidates = (HoughCandidate *)malloc(sizeof(HoughCandidate) * MAX(numAngle * numRho, 1));
+    int count = 0;
+    for (int n = 0; n < numAngle; n++) {
+        for (int r = 0; r < numRho; r++) {
+            const int base = (n + 1) * stride + r + 1;
+            const int v = acc[base];
+            if (v > threshold && v > acc[base - 1] && v >= acc[base + 1] && v > acc[base - stride]
+                && v >= acc[base + stride]) {
+                candidates[count].votes = v;
+                candidates[count].index = base;
+                count++;
+            }
+        }
+    }
+    qsort(candidates, (size_t)count, sizeof(HoughCandidate), &compareHoughCandidate);
+
+    count = MIN(count, maxLines);
+    for (int i = 0; i < count; i++) {
+        const int n = candidates[i].index / stride - 1;
+        const int r = candidates[i].index % stride - 1;
+        lines[i].rho = (r - (numRho - 1) / 2) * rhoStep;
+        lines[i].theta = n * thetaStep;
+        lines[i].votes = candidates[i].votes;
+    }
+
+    free(candidates);
+    free(acc);
+    releaseHoughSpace(&space);
+    return count;
+}
+
+int scvHoughLinesP(const ScvImage *edges, float rhoStep, float thetaStep, int threshold, int minLength, int maxGap,
+                   ScvLineSegment *segments, int maxSegments) {
+    // Progressive probabilistic Hough transform, see Matas et al., "Robust Detection of Lines Using the
+    // Progressive Probabilistic Hough Transform"
+    HoughSpace space;
+    if (maxSegments <= 0 || !createHoughSpace(edges, rhoStep, thetaStep, &space)) {
+        return 0;
+    }
+
+    const int w = edges->width;
+    const int h = edges->height;
+    const int numAngle = space.numAngle;
+    const int numRho = space.numRho;
+    const int shift = 16;
+    int *acc = (int *)calloc((size_t)numAngle * numRho, sizeof(int));
+
+    // 0 for no edge or removed, 1 for an edge that has not voted yet, 2 for one that has voted
+    ScvUByte *mask = (ScvUByte *)calloc((size_t)w * h, 1);
+    for (int i = 0; i < space.pointCount; i++) {
+        mask[space.points[i * 2 + 1] * w + space.points[i * 2]] = 1;
+    }
+
+    // Points are visited in random order
+    unsigned int seed = 2463534242u;
+    for (int i = space.pointCount - 1; i > 0; i--) {
+        const int j = (int)(nextRandom(&seed) % (unsigned int)(i + 1));
+        const int tx = space.points[i * 2], ty = space.points[i * 2 + 1];
+        space.points[i * 2] = space.points[j * 2];
+        space.points[i * 2 + 1] = space.points[j * 2 + 1];
+        space.points[j * 2] = tx;
+        space.points[j * 2 + 1] = ty;
+    }
+
+    int count = 0;
+    for (int i = 0; i < space.pointCount && count < maxSegments; i++) {
+        const int px = space.points[i * 2];
+        const int py = space.points[i * 2 + 1];
+        if (0 == mask[py * w + px]) {
+            continue;
+        }
+
+        // Vote, and find the strongest line through the point
+        int maxVal = threshold - 1;
+        int maxN = 0;
+        for (int n = 0; n < numAngle; n++) {
+            const int v = ++acc[n * numRho + houghRho(&space, n, px, py)];
+            if (v > maxVal) {
+                maxVal = v;
+                maxN = n;
+            }
+        }
+        mask[py * w + px] = 2;
+        if (maxVal < threshold) {
+            continue;
+        }
+
+        // Walk along the line in both directions from the point, in fixed point along the minor axis
+        const float a = -space.tabSin[maxN];
+        const float b = space.tabCos[maxN];
+        const int xFlag = fabsf(a) > fabsf(b);
+        int x0 = px, y0 = py, dx0, dy0;
+        if (xFlag) {
+            dx0 = a > 0 ? 1 : -1;
+            dy0 = (int)lrintf(b * (1 << shift) / fabsf(a));
+            y0 = (y0 << shift) + (1 << (shift - 1));
+        } else {
+            dy0 = b > 0 ? 1 : -1;
+            dx0 = (int)lrintf(a * (1 << shift) / fabsf(b));
+            x0 = (x0 << shift) + (1 << (shift - 1));
+        }
+
+        ScvPoint ends[2] = {{px, py}, {px, py}};
+        for (int k = 0; k < 2; k++) {
+            int gap = 0;
+            const int dx = k ? -dx0 : dx0;
+            const int dy = k ? -dy0 : dy0;
+            for (int x = x0, y = y0;; x += dx, y += dy) {
+                const int ex = xFlag ? x : x >> shift;
+                const int ey = xFlag ? y >> shift : y;
+                if (ex < 0 || ex >= w || ey < 0 || ey >= h) {
+                    break;
+                }
+                if (mask[ey * w + ex]) {
+                    gap = 0;
+                    ends[k] = scvPoint(ex, ey);
+                } else if (++gap > maxGap) {
+                    break;
+                }
+            }
+        }
+
+        const int good = abs(ends[1].x - ends[0].x) >= minLength || abs(ends[1].y - ends[0].y) >= minLength;
+
+        // Points of the segment are removed, and their votes are taken back if it is kept
+        for (int k = 0; k < 2; k++) {
+            const int dx = k ? -dx0 : dx0;
+            const int dy = k ? -dy0 : dy0;
+            for (int x = x0, y = y0;; x += dx, y += dy) {
+                const int ex = xFlag ? x : x >> shift;
+                const int ey = xFlag ? y >> shift : y;
+                ScvUByte *m = &mask[ey * w + ex];
+                if (*m) {
+                    if (good && 2 == *m) {
+                        for (int n = 0; n < numAngle; n++) {
+                            acc[n * numRho + houghRho(&space, n, ex, ey)]--;
+                        }
+                    }
+                    *m = 0;
+                }
+                if (ex == ends[k].x && ey == ends[k].y) {
+                    break;
+                }
+            }
+        }
+
+        if (good) {
+            segments[count].start = ends[0];
+            segments[count].end = ends[1];
+            count++;
+        }
+    }
+
+    free(mask);
+    free(acc);
+    releaseHoughSpace(&space);
+    return count;
+}
+
+#pragma mark-- Template Matching
+
+void scvMatchTemplate(const ScvImage *image, const ScvImage *templ, SCV_MATCH_TYPE type, ScvMat *result) {
+    if (templ->width > image->width || templ->height > image->height || templ->width <= 0 || templ->height <= 0
+        || result->rows != image->height - templ->height + 1 || result->cols != image->width - templ->width + 1
+        || SCV_DEPTH_8U != image->depth || SCV_DEPTH_8U != templ->depth) {
+        return;
+    }
+
+    ScvMat *imageMat = grayMatOf(image);
+    ScvMat *templMat = grayMatOf(templ);
+    MatchIntegrals integrals = createMatchIntegrals(imageMat);
+    matchMat(imageMat, templMat, type, &integrals, result->data);
+    free(integrals.sum);
+    scvReleaseMat(imageMat);
+    scvReleaseMat(templMat);
+}
+
+ScvPoint scvFindTemplate(const ScvImage *image, const ScvImage *templ, SCV_MATCH_TYPE type, int levels, float *score) {
+    if (templ->width > image->width || templ->height > image->height || templ->width <= 0 || templ->height <= 0
+        || SCV_DEPTH_8U != image->depth || SCV_DEPTH_8U != templ->depth) {
+        return scvPoint(-1, -1);
+    }
+
+    // Pyramids, level 0 is the full size
+    ScvMat *images[32];
+    ScvMat *templs[32];
+    images[0] = grayMatOf(image);
+    templs[0] = grayMatOf(templ);
+    int count = 1;
+    while (count < MIN(levels + 1, 32) && templs[count - 1]->rows / 2 >= MATCH_MIN_TEMPLATE
+           && templs[count - 1]->cols / 2 >= MATCH_MIN_TEMPLATE) {
+        images[count] = halveMat(images[count - 1]);
+        templs[count] = halveMat(templs[count - 1]);
+        count++;
+    }
+
+    // Full search at the coarsest level
+    const ScvMat *coarse = images[count - 1];
+    const ScvMat *coarseTempl = templs[count - 1];
+    int outRows = coarse->rows - coarseTempl->rows + 1;
+    int outCols = coarse->cols - coarseTempl->cols + 1;
+    float *values = (float *)malloc(sizeof(float) * outRows * outCols);
+    MatchIntegrals integrals = createMatchIntegrals(coarse);
+    matchMat(coarse, coarseTempl, type, &integrals, values);
+    free(integrals.sum);
+    int best = bestMatch(values, outRows * outCols, type);
+    int bx = best % outCols;
+    int by = best / outCols;
+    float bestScore = values[best];
+    free(values);
+
+    // Then only around the match at every finer level
+    const int side = 2 * MATCH_REFINE_RADIUS + 2;
+    float window[(2 * MATCH_REFINE_RADIUS + 2) * (2 * MATCH_REFINE_RADIUS + 2)];
+    for (int l = count - 2; l >= 0; l--) {
+        const ScvMat *img = images[l];
+        const ScvMat *t = templs[l];
+        outRows = img->rows - t->rows + 1;
+        outCols = img->cols - t->cols + 1;
+        const int x0 = MIN(MAX(bx * 2 - MATCH_REFINE_RADIUS, 0), outCols - 1);
+        const int y0 = MIN(MAX(by * 2 - MATCH_REFINE_RADIUS, 0), outRows - 1);
+        const int cols = MIN(side, outCols - x0);
+        const int rows = MIN(side, outRows - y0);
+
+        integrals = createMatchIntegrals(img);
+        crossCorrelateDirect(img, t, x0, y0, cols, rows, window);
+        scoreMatches(&integrals, t, type, x0, y0, cols, rows, window);
+        free(integrals.sum);
+        best = bestMatch(window, cols * rows, type);
+        bx = x0 + best % cols;
+        by = y0 + best / cols;
+        bestScore = window[best];
+    }
+
+    for (int l = 0; l < count; l++) {
+        scvReleaseMat(images[l]);
+        scvReleaseMat(templs[l]);
+    }
+    if (score) {
+        *score = bestScore;
+    }
+    return scvPoint(bx, by);
+}
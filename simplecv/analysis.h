@@ -0,0 +1,93 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "types.h"
+
+#ifndef SIMPLECV_ANALYSIS_H
+#define SIMPLECV_ANALYSIS_H
+
+#pragma mark - Make
+
+ScvLabels *scvCreateLabels(ScvSize size);
+
+void scvReleaseLabels(ScvLabels *labels);
+
+#pragma mark - Connected Components
+
+/**
+ * Labels the connected components of a binary image (e.g. the output of scvThreshold),
+ * pixels whose value is not 0 are foreground.
+ *
+ * The connectivity must be 4 or 8.
+ * The image is split into the given number of horizontal strips which are labeled
+ * independently (in parallel when built with OpenMP) and merged afterwards,
+ * pass 1 or less to label it in one strip.
+ *
+ * Returns the component count, excluding background.
+ */
+int scvConnectedComponents(const ScvImage *image, ScvLabels *labels, int connectivity, int strips);
+
+#pragma mark - Hough Lines
+
+/**
+ * Standard Hough transform of an SCV_DEPTH_8U edge map (e.g. the output of scvCanny),
+ * pixels whose value is not 0 are edges. Other depths give no lines.
+ * The accumulator has a bin every rhoStep pixels and every thetaStep radians,
+ * lines are its local maxima with more than threshold votes, strongest first.
+ * Voting is parallel when built with OpenMP.
+ *
+ * Returns the number of lines written to lines, at most maxLines.
+ */
+int scvHoughLines(const ScvImage *edges, float rhoStep, float thetaStep, int threshold, ScvLine *lines, int maxLines);
+
+/**
+ * Progressive probabilistic Hough transform of the same edge maps, finds line segments of at least minLength pixels
+ * (along x or y) whose edge pixels are at most maxGap pixels apart.
+ * Points are visited in a fixed pseudo-random order, so the result is reproducible.
+ *
+ * Returns the number of segments written to segments, at most maxSegments.
+ */
+int scvHoughLinesP(const ScvImage *edges, float rhoStep, float thetaStep, int threshold, int minLength, int maxGap,
+                   ScvLineSegment *segments, int maxSegments);
+
+#pragma mark - Template Matching
+
+/**
+ * Scores every position of a template in an image, both SCV_DEPTH_8U and gray-scaled
+ * (the red channel is used like scvCanny), result is left untouched for other depths.
+ * result must be (image height - template height + 1) * (image width - template width + 1),
+ * result[y][x] is the score of the template placed with its top-left corner at (x, y).
+ * Window energies come from summed-area tables, the cross-correlation is done directly
+ * or through FFT, whichever is cheaper for the sizes.
+ */
+void scvMatchTemplate(const ScvImage *image, const ScvImage *templ, SCV_MATCH_TYPE type, ScvMat *result);
+
+/**
+ * Finds the best position of a template, coarse to fine:
+ * up to levels times halved images are searched fully at the coarsest level,
+ * then only around the match at every finer level. Pass 0 levels for a full search at full size.
+ * The score of the match is stored to score if it is not NULL.
+ *
+ * Returns the top-left corner of the match, or (-1, -1) if the template is larger than the image
+ * or either is not SCV_DEPTH_8U.
+ */
+ScvPoint scvFindTemplate(const ScvImage *image, const ScvImage *templ, SCV_MATCH_TYPE type, int levels, float *score);
+
+#endif // SIMPLECV_ANALYSIS_H
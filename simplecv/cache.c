@@ -0,0 +1,390 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <memory.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "core.h"
+
+#pragma mark - Inner
+
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3 1609587929392839161ULL
+#define PRIME64_4 9650029242287828579ULL
+#define PRIME64_5 2870177450012600261ULL
+
+#define CACHE_INITIAL_BUCKETS 64
+
+typedef unsigned long long UInt64;
+
+typedef enum _CACHE_OP { CACHE_OP_WARP_AFFINE, CACHE_OP_EQUALIZE_HIST, CACHE_OP_SMOOTH, CACHE_OP_CANNY } CACHE_OP;
+
+/**
+ * Streaming state of xxHash64, so that the rows of an image can be fed one by one.
+ * https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+typedef struct _HashState {
+    UInt64 acc[4];
+    UInt64 total;
+    unsigned char mem[32];
+    int memSize;
+    UInt64 seed;
+} HashState;
+
+UInt64 rotl64(UInt64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+UInt64 read64(const unsigned char *p) {
+    UInt64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+unsigned int read32(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+UInt64 hashRound(UInt64 acc, UInt64 input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+UInt64 hashMergeRound(UInt64 acc, UInt64 val) {
+    acc ^= hashRound(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+void hashInit(HashState *state, UInt64 seed) {
+    state->acc[0] = seed + PRIME64_1 + PRIME64_2;
+    state->acc[1] = seed + PRIME64_2;
+    state->acc[2] = seed;
+    state->acc[3] = seed - PRIME64_1;
+    state->total = 0;
+    state->memSize = 0;
+    state->seed = seed;
+}
+
+void hashStripes(UInt64 *acc, const unsigned char *p, size_t stripes) {
+    // Four independent lanes
+    UInt64 v0 = acc[0], v1 = acc[1], v2 = acc[2], v3 = acc[3];
+    for (size_t i = 0; i < stripes; i++, p += 32) {
+        v0 = hashRound(v0, read64(p));
+        v1 = hashRound(v1, read64(p + 8));
+        v2 = hashRound(v2, read64(p + 16));
+        v3 = hashRound(v3, read64(p + 24));
+    }
+    acc[0] = v0;
+    acc[1] = v1;
+    acc[2] = v2;
+    acc[3] = v3;
+}
+
+void hashUpdate(HashState *state, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    state->total += len;
+
+    if (state->memSize + len < 32) {
+        memcpy(state->mem + state->memSize, p, len);
+        state->memSize += (int)len;
+        return;
+    }
+
+    if (state->memSize > 0) {
+        const size_t fill = 32 - state->memSize;
+        memcpy(state->mem + state->memSize, p, fill);
+        hashStripes(state->acc, state->mem, 1);
+        p += fill;
+        len -= fill;
+        state->memSize = 0;
+    }
+
+    hashStripes(state->acc, p, len / 32);
+    p += len / 32 * 32;
+    len %= 32;
+
+    memcpy(state->mem, p, len);
+    state->memSize = (int)len;
+}
+
+UInt64 hashDigest(const HashState *state) {
+    UInt64 h;
+    if (state->total >= 32) {
+        const UInt64 *v = state->acc;
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        h = hashMergeRound(h, v[0]);
+        h = hashMergeRound(h, v[1]);
+        h = hashMergeRound(h, v[2]);
+        h = hashMergeRound(h, v[3]);
+    } else {
+        h = state->seed + PRIME64_5;
+    }
+    h += state->total;
+
+    const unsigned char *p = state->mem;
+    int len = state->memSize;
+    for (; len >= 8; len -= 8, p += 8) {
+        h ^= hashRound(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (len >= 4) {
+        h ^= read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        len -= 4;
+    }
+    for (; len > 0; len--, p++) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+UInt64 hashBytes(const void *data, size_t len) {
+    HashState state;
+    hashInit(&state, 0);
+    hashUpdate(&state, data, len);
+    return hashDigest(&state);
+}
+
+int bucketOf(const ScvCache *cache, int op, UInt64 imageHash, UInt64 paramsHash) {
+    const UInt64 h = imageHash ^ rotl64(paramsHash, 17) ^ ((UInt64)op * PRIME64_1);
+    return (int)(h & (UInt64)(cache->bucketCount - 1));
+}
+
+void unlinkEntry(ScvCache *cache, ScvCacheEntry *entry) {
+    if (NULL != entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (NULL != entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+void pushFront(ScvCache *cache, ScvCacheEntry *entry) {
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (NULL != cache->head) {
+        cache->head->prev = entry;
+    }
+    cache->head = entry;
+    if (NULL == cache->tail) {
+        cache->tail = entry;
+    }
+}
+
+void evictEntry(ScvCache *cache, ScvCacheEntry *entry) {
+    ScvCacheEntry **link = &cache->buckets[bucketOf(cache, entry->op, entry->imageHash, entry->paramsHash)];
+    while (*link != entry) {
+        link = &(*link)->chain;
+    }
+    *link = entry->chain;
+
+    unlinkEntry(cache, entry);
+    cache->used -= entry->bytes;
+    cache->count--;
+    scvReleaseImage(entry->result);
+    free(entry);
+}
+
+void growBuckets(ScvCache *cache) {
+    const int oldCount = cache->bucketCount;
+    ScvCacheEntry **old = cache->buckets;
+
+    cache->bucketCount = oldCount * 2;
+    cache->buckets = (ScvCacheEntry **)malloc(cache->bucketCount * sizeof(ScvCacheEntry *));
+    memset(cache->buckets, 0, cache->bucketCount * sizeof(ScvCacheEntry *));
+    for (int i = 0; i < oldCount; i++) {
+        for (ScvCacheEntry *entry = old[i], *next; NULL != entry; entry = next) {
+            next = entry->chain;
+            const int b = bucketOf(cache, entry->op, entry->imageHash, entry->paramsHash);
+            entry->chain = cache->buckets[b];
+            cache->buckets[b] = entry;
+        }
+    }
+    free(old);
+}
+
+/**
+ * Copies the cached result into dst and returns SCV_TRUE on a hit.
+ */
+ScvBool lookupResult(ScvCache *cache, int op, UInt64 imageHash, UInt64 paramsHash, ScvImage *dst) {
+    ScvCacheEntry *entry = cache->buckets[bucketOf(cache, op, imageHash, paramsHash)];
+    for (; NULL != entry; entry = entry->chain) {
+        if (entry->op == op && entry->imageHash == imageHash && entry->paramsHash == paramsHash
+            && entry->result->width == dst->width && entry->result->height == dst->height
+            && entry->result->depth == dst->depth) {
+            break;
+        }
+    }
+    if (NULL == entry) {
+        cache->misses++;
+        return SCV_FALSE;
+    }
+
+    cache->hits++;
+    unlinkEntry(cache, entry);
+    pushFront(cache, entry);
+    scvCopyImage(entry->result, dst);
+    return SCV_TRUE;
+}
+
+void storeResult(ScvCache *cache, int op, UInt64 imageHash, UInt64 paramsHash, const ScvImage *result) {
+    const size_t bytes = (size_t)result->widthBytes * result->height + sizeof(ScvImage);
+    if (bytes > cache->budget) {
+        return;
+    }
+    while (cache->used + bytes > cache->budget) {
+        evictEntry(cache, cache->tail);
+    }
+    if (cache->count >= cache->bucketCount) {
+        growBuckets(cache);
+    }
+
+    ScvCacheEntry *entry = (ScvCacheEntry *)malloc(sizeof(ScvCacheEntry));
+    entry->imageHash = imageHash;
+    entry->paramsHash = paramsHash;
+    entry->op = op;
+    entry->result = scvCloneImage(result);
+    entry->bytes = bytes;
+
+    const int b = bucketOf(cache, op, imageHash, paramsHash);
+    entry->chain = cache->buckets[b];
+    cache->buckets[b] = entry;
+    pushFront(cache, entry);
+    cache->used += bytes;
+    cache->count++;
+}
+
+#pragma mark - Export
+
+#pragma mark-- Make
+
+ScvCache *scvCreateCache(size_t budget) {
+    ScvCache *cache = (ScvCache *)malloc(sizeof(ScvCache));
+    cache->budget = budget;
+    cache->used = 0;
+    cache->count = 0;
+    cache->bucketCount = CACHE_INITIAL_BUCKETS;
+    cache->buckets = (ScvCacheEntry **)malloc(cache->bucketCount * sizeof(ScvCacheEntry *));
+    memset(cache->buckets, 0, cache->bucketCount * sizeof(ScvCacheEntry *));
+    cache->head = cache->tail = NULL;
+    cache->hits = cache->misses = 0;
+    return cache;
+}
+
+void scvReleaseCache(ScvCache *cache) {
+    scvClearCache(cache);
+    free(cache->buckets);
+    free(cache);
+}
+
+void scvClearCache(ScvCache *cache) {
+    while (NULL != cache->tail) {
+        evictEntry(cache, cache->tail);
+    }
+}
+
+#pragma mark-- Hash
+
+unsigned long long scvHashImage(const ScvImage *image) {
+    HashState state;
+    hashInit(&state, 0);
+    int size[3] = {image->width, image->height, image->depth};
+    hashUpdate(&state, size, sizeof(size));
+    const size_t rowBytes = (size_t)image->width * 3 * scvGetDepthSize(image->depth);
+    for (int y = 0; y < image->height; y++) {
+        hashUpdate(&state, scvGetRowRef(image, y), rowBytes);
+    }
+    return hashDigest(&state);
+}
+
+#pragma mark-- Cached Operations
+
+void scvCachedWarpAffine(ScvCache *cache, const ScvImage *src, ScvImage *dst, const ScvMat *mat, ScvPixel fillPxl) {
+    if (!(2 == mat->rows && 3 == mat->cols)) {
+        return;
+    }
+
+    struct {
+        float m[6];
+        int fill;
+    } params;
+    memset(&params, 0, sizeof(params));
+    memcpy(params.m, mat->data, sizeof(params.m));
+    params.fill = fillPxl.b | fillPxl.g << 8 | fillPxl.r << 16;
+
+    const UInt64 imageHash = scvHashImage(src);
+    const UInt64 paramsHash = hashBytes(&params, sizeof(params));
+    if (lookupResult(cache, CACHE_OP_WARP_AFFINE, imageHash, paramsHash, dst)) {
+        return;
+    }
+    scvWarpAffine(src, dst, mat, fillPxl);
+    storeResult(cache, CACHE_OP_WARP_AFFINE, imageHash, paramsHash, dst);
+}
+
+void scvCachedEqualizeHist(ScvCache *cache, const ScvImage *src, const ScvHistogram *hist, ScvImage *dst) {
+    HashState state;
+    hashInit(&state, (UInt64)hist->grayingType);
+    hashUpdate(&state, hist->val, 256 * sizeof(int));
+
+    const UInt64 imageHash = scvHashImage(src);
+    const UInt64 paramsHash = hashDigest(&state);
+    if (lookupResult(cache, CACHE_OP_EQUALIZE_HIST, imageHash, paramsHash, dst)) {
+        return;
+    }
+    scvEqualizeHist(src, hist, dst);
+    storeResult(cache, CACHE_OP_EQUALIZE_HIST, imageHash, paramsHash, dst);
+}
+
+void scvCachedSmooth(ScvCache *cache, const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type) {
+    const int params = type;
+
+    const UInt64 imageHash = scvHashImage(src);
+    const UInt64 paramsHash = hashBytes(&params, sizeof(params));
+    if (lookupResult(cache, CACHE_OP_SMOOTH, imageHash, paramsHash, dst)) {
+        return;
+    }
+    scvSmooth(src, dst, type);
+    storeResult(cache, CACHE_OP_SMOOTH, imageHash, paramsHash, dst);
+}
+
+void scvCachedCanny(ScvCache *cache, const ScvImage *image, ScvImage *path) {
+    const UInt64 imageHash = scvHashImage(image);
+    if (lookupResult(cache, CACHE_OP_CANNY, imageHash, 0, path)) {
+        return;
+    }
+    scvCanny(image, path);
+    storeResult(cache, CACHE_OP_CANNY, imageHash, 0, path);
+}
@@ -0,0 +1,61 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stddef.h>
+
+#include "types.h"
+
+#ifndef SIMPLECV_CACHE_H
+#define SIMPLECV_CACHE_H
+
+#pragma mark - Make
+
+/**
+ * Creates an LRU cache of operation results holding at most budget bytes of pixel data.
+ */
+ScvCache *scvCreateCache(size_t budget);
+
+void scvReleaseCache(ScvCache *cache);
+
+void scvClearCache(ScvCache *cache);
+
+#pragma mark - Hash
+
+/**
+ * 64-bit xxHash of the size and the pixels of an image, row padding is not included.
+ */
+unsigned long long scvHashImage(const ScvImage *image);
+
+#pragma mark - Cached Operations
+
+/**
+ * Same as the uncached operations, except that the result is looked up by the content of
+ * the source image and the other arguments first, and only calculated and stored on a miss.
+ */
+
+void scvCachedWarpAffine(ScvCache *cache, const ScvImage *src, ScvImage *dst, const ScvMat *mat, ScvPixel fillPxl);
+
+void scvCachedEqualizeHist(ScvCache *cache, const ScvImage *src, const ScvHistogram *hist, ScvImage *dst);
+
+void scvCachedSmooth(ScvCache *cache, const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type);
+
+void scvCachedCanny(ScvCache *cache, const ScvImage *image, ScvImage *path);
+
+#endif // SIMPLECV_CACHE_H
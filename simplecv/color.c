@@ -0,0 +1,277 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "color.h"
+#include "core.h"
+
+#pragma mark - Inner
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// Fixed-point values have COLOR_SHIFT fraction bits
+#define COLOR_SHIFT 14
+#define COLOR_ONE (1 << COLOR_SHIFT)
+#define COLOR_FIX(x) ((int)((x) * COLOR_ONE + 0.5))
+#define COLOR_DESCALE(x) (((x) + (1 << (COLOR_SHIFT - 1))) >> COLOR_SHIFT)
+
+#define HSV_DIV_SHIFT 12
+
+// Lab to BGR goes through XYZ up to LAB_INV_MAX times the white, the matrix has fewer bits to stay in 32 bits
+#define LAB_INV_SHIFT 2
+#define LAB_INV_MIN (-COLOR_ONE / 2)
+#define LAB_INV_MAX (COLOR_ONE * 7 / 4)
+#define LAB_INV_SIZE ((LAB_INV_MAX - LAB_INV_MIN) >> LAB_INV_SHIFT)
+#define LAB_MATRIX_SHIFT 12
+
+SCV_INLINE int saturateUByte(int v) {
+    return MIN(MAX(v, 0), 255);
+}
+
+static int colorTablesReady = 0;
+
+// (255 << HSV_DIV_SHIFT) / v and (180 << HSV_DIV_SHIFT) / (6 * diff), so that S and H need no division
+static int hsvSatDiv[256];
+static int hsvHueDiv[256];
+
+// sRGB gamma, 8-bit to linear and back
+static int labGamma[256];
+static ScvUByte labGammaInv[COLOR_ONE + 1];
+
+// f(t) of Lab (cube root above the linear toe) and the 8-bit L of a linear Y
+static int labCbrt[COLOR_ONE + 1];
+static ScvUByte labLightness[COLOR_ONE + 1];
+
+// f of the 8-bit L, and the inverse of f from LAB_INV_MIN to LAB_INV_MAX
+static int labInvLightness[256];
+static int labInvCbrt[LAB_INV_SIZE + 1];
+
+// Linear BGR to XYZ over the white, and XYZ times the white to linear RGB
+static int labMatrix[9];
+static int labInvMatrix[9];
+
+double labF(double t) {
+    const double delta = 6.0 / 29.0;
+    return t > delta * delta * delta ? cbrt(t) : t / (3.0 * delta * delta) + 4.0 / 29.0;
+}
+
+double labInvF(double f) {
+    const double delta = 6.0 / 29.0;
+    return f > delta ? f * f * f : 3.0 * delta * delta * (f - 4.0 / 29.0);
+}
+
+void buildColorTables(void) {
+    hsvSatDiv[0] = hsvHueDiv[0] = 0;
+    for (int i = 1; i < 256; i++) {
+        hsvSatDiv[i] = (int)((255 << HSV_DIV_SHIFT) / (double)i + 0.5);
+        hsvHueDiv[i] = (int)((180 << HSV_DIV_SHIFT) / (6.0 * i) + 0.5);
+    }
+
+    for (int i = 0; i < 256; i++) {
+        const double v = i / 255.0;
+        const double linear = v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+        labGamma[i] = (int)(linear * COLOR_ONE + 0.5);
+    }
+    for (int i = 0; i <= COLOR_ONE; i++) {
+        const double linear = (double)i / COLOR_ONE;
+        const double v = linear <= 0.0031308 ? linear * 12.92 : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+        labGammaInv[i] = (ScvUByte)saturateUByte((int)(v * 255.0 + 0.5));
+        const double f = labF(linear);
+        labCbrt[i] = (int)(f * COLOR_ONE + 0.5);
+        labLightness[i] = (ScvUByte)saturateUByte((int)(2.55 * (116.0 * f - 16.0) + 0.5));
+    }
+
+    for (int i = 0; i < 256; i++) {
+        labInvLightness[i] = (int)((i * 100.0 / 255.0 + 16.0) / 116.0 * COLOR_ONE + 0.5);
+    }
+    for (int i = 0; i <= LAB_INV_SIZE; i++) {
+        const double f = (double)((i << LAB_INV_SHIFT) + LAB_INV_MIN) / COLOR_ONE;
+        labInvCbrt[i] = (int)lround(labInvF(f) * COLOR_ONE);
+    }
+
+    // sRGB primaries with the D65 white
+    const double white[3] = {0.950456, 1.0, 1.088754};
+    const double toXYZ[9] = {
+        0.412453, 0.357580, 0.180423, 0.212671, 0.715160, 0.072169, 0.019334, 0.119193, 0.950227};
+    const double toRGB[9] = {
+        3.240479, -1.53715, -0.498535, -0.969256, 1.875991, 0.041556, 0.055648, -0.204043, 1.057311};
+    for (int row = 0; row < 3; row++) {
+        // Columns are reordered to B, G, R for the forward matrix
+        for (int col = 0; col < 3; col++) {
+            labMatrix[row * 3 + col] = COLOR_FIX(toXYZ[row * 3 + 2 - col] / white[row]);
+            labInvMatrix[row * 3 + col] = (int)lround(toRGB[row * 3 + col] * white[col] * (1 << LAB_MATRIX_SHIFT));
+        }
+    }
+}
+
+/**
+ * Builds the lookup tables on the first call, they are read-only after it.
+ * The flag is checked in a critical section, so conversions started together from several threads build them once.
+ */
+void initColorTables(void) {
+#pragma omp critical(scvColorTables)
+    {
+        if (!colorTablesReady) {
+            buildColorTables();
+            colorTablesReady = 1;
+        }
+    }
+}
+
+/**
+ * Row converters below read a whole pixel before writing it, so src and dst can be the same row.
+ */
+void bgrToHsvRow(const ScvPixel *src, ScvPixel *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        const int b = src[x].b, g = src[x].g, r = src[x].r;
+        const int v = MAX(MAX(b, g), r);
+        const int diff = v - MIN(MIN(b, g), r);
+        const int vr = v == r ? -1 : 0;
+        const int vg = v == g ? -1 : 0;
+
+        const int s = (diff * hsvSatDiv[v] + (1 << (HSV_DIV_SHIFT - 1))) >> HSV_DIV_SHIFT;
+        int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + (~vg & (r - g + 4 * diff))));
+        h = (h * hsvHueDiv[diff] + (1 << (HSV_DIV_SHIFT - 1))) >> HSV_DIV_SHIFT;
+        h += h < 0 ? 180 : 0;
+        dst[x] = scvPixel(h, s, v);
+    }
+}
+
+void hsvToBgrRow(const ScvPixel *src, ScvPixel *dst, int width) {
+    // Which of v, p, q, t goes to b, g and r in every 60 degrees sector
+    static const int sectors[6][3] = {{1, 3, 0}, {1, 0, 2}, {3, 0, 1}, {0, 2, 1}, {0, 1, 3}, {2, 1, 0}};
+    for (int x = 0; x < width; x++) {
+        const int h = src[x].b % 180, s = src[x].g, v = src[x].r;
+        const int sector = h / 30;
+        const int f = h - sector * 30;
+
+        int values[4];
+        values[0] = v;
+        values[1] = (v * (255 - s) + 127) / 255;
+        values[2] = (v * (255 * 30 - s * f) + 255 * 15) / (255 * 30);
+        values[3] = (v * (255 * 30 - s * (30 - f)) + 255 * 15) / (255 * 30);
+        dst[x] = scvPixel(values[sectors[sector][0]], values[sectors[sector][1]], values[sectors[sector][2]]);
+    }
+}
+
+void bgrToYCbCrRow(const ScvPixel *src, ScvPixel *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        const int b = src[x].b, g = src[x].g, r = src[x].r;
+        const int y = COLOR_DESCALE(COLOR_FIX(0.114) * b + COLOR_FIX(0.587) * g + COLOR_FIX(0.299) * r);
+        const int cb = COLOR_DESCALE(COLOR_FIX(0.5) * b - COLOR_FIX(0.331264) * g - COLOR_FIX(0.168736) * r) + 128;
+        const int cr = COLOR_DESCALE(-COLOR_FIX(0.081312) * b - COLOR_FIX(0.418688) * g + COLOR_FIX(0.5) * r) + 128;
+        dst[x] = scvPixel(saturateUByte(y), saturateUByte(cb), saturateUByte(cr));
+    }
+}
+
+void yCbCrToBgrRow(const ScvPixel *src, ScvPixel *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        const int y = src[x].b, cb = src[x].g - 128, cr = src[x].r - 128;
+        const int b = y + COLOR_DESCALE(COLOR_FIX(1.772) * cb);
+        const int g = y + COLOR_DESCALE(-COLOR_FIX(0.344136) * cb - COLOR_FIX(0.714136) * cr);
+        const int r = y + COLOR_DESCALE(COLOR_FIX(1.402) * cr);
+        dst[x] = scvPixel(saturateUByte(b), saturateUByte(g), saturateUByte(r));
+    }
+}
+
+void bgrToLabRow(const ScvPixel *src, ScvPixel *dst, int width) {
+    const int *m = labMatrix;
+    for (int x = 0; x < width; x++) {
+        const int b = labGamma[src[x].b], g = labGamma[src[x].g], r = labGamma[src[x].r];
+        const int cx = MIN(COLOR_DESCALE(m[0] * b + m[1] * g + m[2] * r), COLOR_ONE);
+        const int cy = MIN(COLOR_DESCALE(m[3] * b + m[4] * g + m[5] * r), COLOR_ONE);
+        const int cz = MIN(COLOR_DESCALE(m[6] * b + m[7] * g + m[8] * r), COLOR_ONE);
+
+        const int fx = labCbrt[cx], fy = labCbrt[cy], fz = labCbrt[cz];
+        const int a = COLOR_DESCALE(500 * (fx - fy)) + 128;
+        const int b2 = COLOR_DESCALE(200 * (fy - fz)) + 128;
+        dst[x] = scvPixel(labLightness[cy], saturateUByte(a), saturateUByte(b2));
+    }
+}
+
+// Inverse of f, linearly interpolated between the table entries
+SCV_INLINE int labInvCbrtOf(int f) {
+    const int offset = MIN(MAX(f, LAB_INV_MIN), LAB_INV_MAX - 1) - LAB_INV_MIN;
+    const int i = offset >> LAB_INV_SHIFT;
+    const int t = offset & ((1 << LAB_INV_SHIFT) - 1);
+    return labInvCbrt[i] + (((labInvCbrt[i + 1] - labInvCbrt[i]) * t) >> LAB_INV_SHIFT);
+}
+
+void labToBgrRow(const ScvPixel *src, ScvPixel *dst, int width) {
+    const int *m = labInvMatrix;
+    const int half = 1 << (LAB_MATRIX_SHIFT - 1);
+    for (int x = 0; x < width; x++) {
+        const int fy = labInvLightness[src[x].b];
+        const int fx = fy + (src[x].g - 128) * COLOR_ONE / 500;
+        const int fz = fy - (src[x].r - 128) * COLOR_ONE / 200;
+        const int cx = labInvCbrtOf(fx), cy = labInvCbrtOf(fy), cz = labInvCbrtOf(fz);
+
+        const int r = (m[0] * cx + m[1] * cy + m[2] * cz + half) >> LAB_MATRIX_SHIFT;
+        const int g = (m[3] * cx + m[4] * cy + m[5] * cz + half) >> LAB_MATRIX_SHIFT;
+        const int b = (m[6] * cx + m[7] * cy + m[8] * cz + half) >> LAB_MATRIX_SHIFT;
+        const ScvUByte rv = labGammaInv[MIN(MAX(r, 0), COLOR_ONE)];
+        const ScvUByte gv = labGammaInv[MIN(MAX(g, 0), COLOR_ONE)];
+        const ScvUByte bv = labGammaInv[MIN(MAX(b, 0), COLOR_ONE)];
+        dst[x] = scvPixel(bv, gv, rv);
+    }
+}
+
+#pragma mark - Export
+
+void scvConvertColor(const ScvImage *src, ScvImage *dst, SCV_COLOR_CONVERSION type) {
+    if (src->width != dst->width || src->height != dst->height || SCV_DEPTH_8U != src->depth
+        || SCV_DEPTH_8U != dst->depth) {
+        return;
+    }
+
+    void (*convertRow)(const ScvPixel *, ScvPixel *, int);
+    switch (type) {
+    case SCV_COLOR_BGR2HSV:
+        convertRow = bgrToHsvRow;
+        break;
+    case SCV_COLOR_HSV2BGR:
+        convertRow = hsvToBgrRow;
+        break;
+    case SCV_COLOR_BGR2YCBCR:
+        convertRow = bgrToYCbCrRow;
+        break;
+    case SCV_COLOR_YCBCR2BGR:
+        convertRow = yCbCrToBgrRow;
+        break;
+    case SCV_COLOR_BGR2LAB:
+        convertRow = bgrToLabRow;
+        break;
+    case SCV_COLOR_LAB2BGR:
+        convertRow = labToBgrRow;
+        break;
+    default:
+        return;
+    }
+    initColorTables();
+
+    int y;
+#pragma omp parallel for schedule(static)
+    for (y = 0; y < src->height; y++) {
+        convertRow(scvGetRowRef(src, y), scvGetRowRef(dst, y), src->width);
+    }
+}
@@ -0,0 +1,35 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "types.h"
+
+#ifndef SIMPLECV_COLOR_H
+#define SIMPLECV_COLOR_H
+
+#pragma mark - Color Space
+
+/**
+ * Converts an 8-bit image between BGR and HSV, YCbCr or Lab, see SCV_COLOR_CONVERSION for the layouts.
+ * Everything is integer arithmetic, the non-linear parts (divisions of HSV, gamma and cube root of Lab)
+ * are lookup tables built on the first call. src and dst can be the same image.
+ */
+void scvConvertColor(const ScvImage *src, ScvImage *dst, SCV_COLOR_CONVERSION type);
+
+#endif // SIMPLECV_COLOR_H
@@ -22,11 +22,14 @@
 // Created by Richard Chien on 6/20/16.
 //
 
+#include <limits.h>
 #include <math.h>
 #include <memory.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "core.h"
+#include "filter.h"
 #include "matrix.h"
 
 #pragma mark - Inner
@@ -148,7 +151,7 @@ void calcCDF(int length, const int *src, int *dst) {
     }
 }
 
-void traceEdge(int y, int x, int nThrLow, ScvUByte *pResult, int *pMag, ScvSize sz) {
+void traceEdge(int y, int x, int nThrLow, ScvUByte *pResult, const short *pMag, ScvSize sz) {
     // http://blog.csdn.net/likezhaobin/article/details/6892629
     int xNum[8] = {1, 1, 0, -1, -1, -1, 0, 1};
     int yNum[8] = {0, 1, 1, 1, 0, -1, -1, -1};
@@ -163,39 +166,1092 @@ void traceEdge(int y, int x, int nThrLow, ScvUByte *pResult, int *pMag, ScvSize
     }
 }
 
+ScvRect clipRect(ScvRect rect, int width, int height) {
+    const int x0 = MAX(rect.x, 0);
+    const int y0 = MAX(rect.y, 0);
+    const int x1 = MIN(rect.x + rect.width, width);
+    const int y1 = MIN(rect.y + rect.height, height);
+    return scvRect(x0, y0, MAX(x1 - x0, 0), MAX(y1 - y0, 0));
+}
+
+ScvRect expandRect(ScvRect rect, int halo, int width, int height) {
+    return clipRect(scvRect(rect.x - halo, rect.y - halo, rect.width + 2 * halo, rect.height + 2 * halo), width, height);
+}
+
+/**
+ * Collect the dirty blocks, grown by the given number of blocks, as non-overlapping rects.
+ * Runs of blocks in a block row make one rect, which is extended downwards while the run repeats.
+ * The returned array must be freed by the caller.
+ */
+ScvRect *collectDirtyRects(const ScvDirtyMap *map, int grow, int *count) {
+    const int cols = map->cols;
+    const int rows = map->rows;
+    const int bs = map->blockSize;
+
+    ScvUByte *flags = (ScvUByte *)malloc((size_t)cols * rows);
+    for (int by = 0; by < rows; by++) {
+        for (int bx = 0; bx < cols; bx++) {
+            ScvUByte dirty = 0;
+            for (int y = MAX(by - grow, 0); y <= MIN(by + grow, rows - 1) && !dirty; y++) {
+                for (int x = MAX(bx - grow, 0); x <= MIN(bx + grow, cols - 1) && !dirty; x++) {
+                    dirty = map->dirty[y * cols + x];
+                }
+            }
+            flags[by * cols + bx] = dirty;
+        }
+    }
+
+    ScvRect *rects = (ScvRect *)malloc((size_t)cols * rows * sizeof(ScvRect));
+    int n = 0;
+    int prevRowStart = 0;
+    for (int by = 0; by < rows; by++) {
+        const int rowStart = n;
+        for (int bx = 0; bx < cols;) {
+            if (!flags[by * cols + bx]) {
+                bx++;
+                continue;
+            }
+            const int start = bx;
+            while (bx < cols && flags[by * cols + bx]) {
+                bx++;
+            }
+
+            ScvRect rect = clipRect(scvRect(start * bs, by * bs, (bx - start) * bs, bs), map->width, map->height);
+            int merged = 0;
+            for (int i = prevRowStart; i < rowStart; i++) {
+                if (rects[i].x == rect.x && rects[i].width == rect.width && rects[i].y + rects[i].height == rect.y) {
+                    rects[i].height += rect.height;
+                    merged = 1;
+                    break;
+                }
+            }
+            if (!merged) {
+                rects[n++] = rect;
+            }
+        }
+        prevRowStart = rowStart;
+    }
+
+    free(flags);
+    *count = n;
+    return rects;
+}
+
+void grayingRect(const ScvImage *src, ScvImage *dst, SCV_GRAYING_TYPE type, ScvRect rect) {
+    for (int iy = rect.y; iy < rect.y + rect.height; iy++) {
+        for (int ix = rect.x; ix < rect.x + rect.width; ix++) {
+            ScvPixel sPxl = scvGetPixel(src, ix, iy);
+            ScvPixel *dPxlRef = scvGetPixelRef(dst, ix, iy);
+            if (NULL != dPxlRef) {
+                int value = grayValueOfPixel(sPxl, type);
+                if (value >= 0 && value < 256) {
+                    dPxlRef->b = dPxlRef->g = dPxlRef->r = (ScvUByte)value;
+                }
+            }
+        }
+    }
+}
+
+void thresholdRect(const ScvImage *src, ScvImage *dst, SCV_GRAYING_TYPE grayingType, float thresh, ScvRect rect) {
+    for (int iy = rect.y; iy < rect.y + rect.height; iy++) {
+        for (int ix = rect.x; ix < rect.x + rect.width; ix++) {
+            ScvPixel sPxl = scvGetPixel(src, ix, iy);
+            ScvPixel *dPxlRef = scvGetPixelRef(dst, ix, iy);
+            if (NULL != dPxlRef) {
+                int value = grayValueOfPixel(sPxl, grayingType);
+                if (value >= 0 && value < 256) {
+                    dPxlRef->b = dPxlRef->g = dPxlRef->r = (ScvUByte)(value > thresh ? 255 : 0);
+                }
+            }
+        }
+    }
+}
+
+void histRect(const ScvImage *image, ScvHistogram *hist, ScvRect rect, int delta) {
+    for (int iy = rect.y; iy < rect.y + rect.height; iy++) {
+        for (int ix = rect.x; ix < rect.x + rect.width; ix++) {
+            int index = grayValueOfPixel(scvGetPixel(image, ix, iy), hist->grayingType);
+            if (index >= 0 && index < 256) {
+                hist->val[index] += delta;
+            }
+        }
+    }
+}
+
+void smoothRect(const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type, ScvRect rect) {
+    /**
+     * [i][0] -> dx;
+     * [i][1] -> dy;
+     */
+    int step[9][3] = {{-1, -1}, // Top-left
+                      {0, -1}, // Top
+                      {1, -1}, // Top-right
+                      {-1, 0}, // Left
+                      {0, 0}, // Center
+                      {1, 0}, // Right
+                      {-1, 1}, // Bottom-left
+                      {0, 1}, // Bottom
+                      {1, 1}}; // Bottom-right
+
+    // Weight template
+    int avgWeight[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+    int gaussianWeight[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+
+    int *weight;
+    switch (type) {
+    case SCV_SMOOTH_GAUSSIAN:
+        weight = gaussianWeight;
+        break;
+    case SCV_SMOOTH_AVG:
+    case SCV_SMOOTH_MEDIAN:
+    default:
+        weight = avgWeight;
+        break;
+    }
+
+    if (rect.width <= 0 || rect.height <= 0) {
+        return;
+    }
+
+    /**
+     * Source rows around rect are copied into a ring of 3 rows before a destination row is written,
+     * so src may be dst.
+     */
+    const int x0 = MAX(rect.x - 1, 0);
+    const int x1 = MIN(rect.x + rect.width + 1, src->width);
+    const int span = MAX(x1 - x0, 1);
+    ScvPixel *ring = (ScvPixel *)malloc(sizeof(ScvPixel) * span * 3);
+    for (int iy = MAX(rect.y - 1, 0); iy < MIN(rect.y + 1, src->height); iy++) {
+        memcpy(ring + iy % 3 * span, scvGetRowRef(src, iy) + x0, sizeof(ScvPixel) * (x1 - x0));
+    }
+
+    int r, g, b;
+    int arrR[9], arrG[9], arrB[9];
+    int w[9];
+    for (int iy = rect.y; iy < rect.y + rect.height; iy++) {
+        if (iy + 1 < src->height) {
+            memcpy(ring + (iy + 1) % 3 * span, scvGetRowRef(src, iy + 1) + x0, sizeof(ScvPixel) * (x1 - x0));
+        }
+
+        for (int ix = rect.x; ix < rect.x + rect.width; ix++) {
+            int count = 0;
+            for (int i = 0; i < 9; i++) {
+                int curX = ix + step[i][0];
+                int curY = iy + step[i][1];
+                if (curX >= 0 && curX < src->width && curY >= 0 && curY < src->height) {
+                    ScvPixel pxl = ring[curY % 3 * span + curX - x0];
+                    arrR[count] = pxl.r;
+                    arrG[count] = pxl.g;
+                    arrB[count] = pxl.b;
+                    w[count] = weight[i];
+                    count++;
+                }
+            }
+
+            switch (type) {
+            case SCV_SMOOTH_GAUSSIAN:
+            case SCV_SMOOTH_AVG:
+                r = (int)(avgArrWeighed(count, arrR, w) + 0.5f);
+                g = (int)(avgArrWeighed(count, arrG, w) + 0.5f);
+                b = (int)(avgArrWeighed(count, arrB, w) + 0.5f);
+                break;
+            case SCV_SMOOTH_MEDIAN:
+                r = (int)(medianArr(count, arrR) + 0.5f);
+                g = (int)(medianArr(count, arrG) + 0.5f);
+                b = (int)(medianArr(count, arrB) + 0.5f);
+                break;
+            default:
+                r = g = b = -1;
+                break;
+            }
+            if (r >= 0 && g >= 0 && b >= 0) {
+                scvSetPixel(dst, ix, iy, scvPixel(b, g, r));
+            }
+        }
+    }
+    free(ring);
+}
+
+/**
+ * Removes the non-maximum suppression candidates inside rect from the histogram,
+ * before they are recalculated.
+ */
+void cannyForgetRect(ScvCannyState *state, ScvRect rect) {
+    const int nWidth = state->width;
+    for (int iy = rect.y; iy < rect.y + rect.height; iy++) {
+        for (int ix = rect.x; ix < rect.x + rect.width; ix++) {
+            const int nPointIdx = iy * nWidth + ix;
+            if (state->N[nPointIdx] == 128) {
+                state->hist[state->M[nPointIdx]]--;
+            }
+        }
+    }
+}
+
+/**
+ * Gaussian filter, gradient and non-maximum suppression of the pixels inside rect,
+ * the stencils around rect are recalculated as well.
+ */
+void cannyRect(const ScvImage *image, ScvCannyState *state, ScvRect rect) {
+    // http://blog.csdn.net/likezhaobin/article/details/6892629
+    const int nWidth = state->width;
+    const int nHeight = state->height;
+    short *P = state->P;
+    short *Q = state->Q;
+    short *M = state->M;
+    ScvUByte *N = state->N;
+
+    // Gaussian filter
+    smoothRect(image, state->filtered, SCV_SMOOTH_GAUSSIAN, expandRect(rect, 2, nWidth, nHeight));
+
+    // Gradient, Q points upwards, i.e. the opposite of dy
+    const ScvRect gradRect = expandRect(rect, 1, nWidth, nHeight);
+    scvSobelRect(state->filtered, gradRect, P, Q, M, SCV_SOBEL_3);
+    for (int iy = gradRect.y; iy < gradRect.y + gradRect.height; iy++) {
+        for (int ix = gradRect.x; ix < gradRect.x + gradRect.width; ix++) {
+            const int i = iy * nWidth + ix;
+            Q[i] = (short)-Q[i];
+            // Sobel responses are 4 times the plain difference, keep the magnitude within the histogram
+            M[i] = (short)((M[i] + 2) / 4);
+        }
+    }
+
+    // Non-maximum suppression
+    int g1, g2, g3, g4;
+    float dTmp1, dTmp2;
+    float dWeight;
+    for (int j = rect.y; j < rect.y + rect.height; j++) {
+        for (int i = rect.x; i < rect.x + rect.width; i++) {
+            int nPointIdx = i + j * nWidth;
+            if (0 == i || 0 == j || nWidth - 1 == i || nHeight - 1 == j || M[nPointIdx] == 0) {
+                N[nPointIdx] = 0;
+                continue;
+            }
+
+            float theta = atan2f(Q[nPointIdx], P[nPointIdx]) * 57.3f;
+            if (theta < 0) theta += 360;
+
+            dTmp1 = dTmp2 = 0.0f;
+            /////////////////////////////////////////////////////
+            /////////       g1  g2                  /////////////
+            /////////           C                   /////////////
+            /////////           g3  g4              /////////////
+            /////////////////////////////////////////////////////
+            if (((theta >= 90) && (theta < 135)) || ((theta >= 270) && (theta < 315))) {
+                g1 = M[nPointIdx - nWidth - 1];
+                g2 = M[nPointIdx - nWidth];
+                g3 = M[nPointIdx + nWidth];
+                g4 = M[nPointIdx + nWidth + 1];
+                dWeight = (float)abs(P[nPointIdx]) / (float)abs(Q[nPointIdx]);
+                dTmp1 = g1 * dWeight + g2 * (1 - dWeight);
+                dTmp2 = g4 * dWeight + g3 * (1 - dWeight);
+            }
+            /////////////////////////////////////////////////////
+            /////////       g1                      /////////////
+            /////////       g2  C   g3              /////////////
+            /////////               g4              /////////////
+            /////////////////////////////////////////////////////
+            else if (((theta >= 135) && (theta < 180)) || ((theta >= 315) && (theta < 360))) {
+                g1 = M[nPointIdx - nWidth - 1];
+                g2 = M[nPointIdx - 1];
+                g3 = M[nPointIdx + 1];
+                g4 = M[nPointIdx + nWidth + 1];
+                dWeight = (float)abs(Q[nPointIdx]) / (float)abs(P[nPointIdx]);
+                dTmp1 = g2 * dWeight + g1 * (1 - dWeight);
+                dTmp2 = g4 * dWeight + g3 * (1 - dWeight);
+            }
+            /////////////////////////////////////////////////////
+            /////////           g1  g2              /////////////
+            /////////           C                   /////////////
+            /////////       g4  g3                  /////////////
+            /////////////////////////////////////////////////////
+            else if (((theta >= 45) && (theta < 90)) || ((theta >= 225) && (theta < 270))) {
+                g1 = M[nPointIdx - nWidth];
+                g2 = M[nPointIdx - nWidth + 1];
+                g3 = M[nPointIdx + nWidth];
+                g4 = M[nPointIdx + nWidth - 1];
+                dWeight = (float)abs(P[nPointIdx]) / (float)abs(Q[nPointIdx]);
+                dTmp1 = g2 * dWeight + g1 * (1 - dWeight);
+                dTmp2 = g3 * dWeight + g4 * (1 - dWeight);
+            }
+            /////////////////////////////////////////////////////
+            /////////               g1              /////////////
+            /////////       g4  C   g2              /////////////
+            /////////       g3                      /////////////
+            /////////////////////////////////////////////////////
+            else if (((theta >= 0) && (theta < 45)) || ((theta >= 180) && (theta < 225))) {
+                g1 = M[nPointIdx - nWidth + 1];
+                g2 = M[nPointIdx + 1];
+                g3 = M[nPointIdx + nWidth - 1];
+                g4 = M[nPointIdx - 1];
+                dWeight = (float)abs(Q[nPointIdx]) / (float)abs(P[nPointIdx]);
+                dTmp1 = g1 * dWeight + g2 * (1 - dWeight);
+                dTmp2 = g3 * dWeight + g4 * (1 - dWeight);
+            }
+
+            if ((M[nPointIdx] >= dTmp1) && (M[nPointIdx] >= dTmp2)) {
+                N[nPointIdx] = 128;
+                state->hist[M[nPointIdx]]++;
+            } else {
+                N[nPointIdx] = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Picks the thresholds from the candidates histogram and traces the edges over the whole image.
+ */
+void cannyHysteresis(ScvCannyState *state, ScvImage *path) {
+    const int nWidth = state->width;
+    const int nHeight = state->height;
+    const int *nHist = state->hist;
+    int i, j;
+
+    int nEdgeNum = nHist[0];
+    int nMaxMag = 0;
+    for (i = 1; i < 1024; i++) {
+        if (nHist[i] != 0) {
+            nMaxMag = i;
+        }
+        nEdgeNum += nHist[i];
+    }
+
+    float dRatHigh = 0.79;
+    float dThrHigh;
+    float dThrLow;
+    float dRatLow = 0.5;
+    int nHighCount = (int)(dRatHigh * nEdgeNum + 0.5f);
+    j = 1;
+    nEdgeNum = nHist[1];
+    while ((j < (nMaxMag - 1)) && (nEdgeNum < nHighCount)) {
+        j++;
+        nEdgeNum += nHist[j];
+    }
+    dThrHigh = j;
+    dThrLow = (int)((dThrHigh)*dRatLow + 0.5f);
+
+    ScvUByte *E = state->E;
+    memcpy(E, state->N, (size_t)nWidth * nHeight);
+    ScvSize sz;
+    sz.width = nWidth;
+    sz.height = nHeight;
+    for (i = 0; i < nHeight; i++) {
+        for (j = 0; j < nWidth; j++) {
+            if ((E[i * nWidth + j] == 128) && (state->M[i * nWidth + j] >= dThrHigh)) {
+                E[i * nWidth + j] = 255;
+                traceEdge(i, j, (int)(dThrLow + 0.5f), E, state->M, sz);
+            }
+        }
+    }
+
+    for (int iy = 0; iy < nHeight; iy++) {
+        ScvPixel *row = scvGetRowRef(path, iy);
+        for (int ix = 0; ix < nWidth; ix++) {
+            row[ix] = scvPixelAll(E[iy * nWidth + ix] != 255 ? 0 : 255);
+        }
+    }
+}
+
+/**
+ * Row alignment of new images, see scvSetImageAlignment.
+ */
+static int imageAlignment = 64;
+
+/**
+ * Rows are aligned and padded so that a row stride is never a multiple of 1 KB,
+ * otherwise vertical neighbours in stencils map to the same few cache sets.
+ */
+int alignedWidthBytes(int rowBytes, int alignment) {
+    int widthBytes = (rowBytes + alignment - 1) / alignment * alignment;
+    if (widthBytes >= 1024 && widthBytes % 1024 == 0) {
+        widthBytes += alignment;
+    }
+    return widthBytes;
+}
+
+/**
+ * The pointer returned by malloc is kept right before the aligned block.
+ */
+void *alignedMalloc(size_t size, int alignment) {
+    char *raw = (char *)malloc(size + alignment + sizeof(void *));
+    if (NULL == raw) {
+        return NULL;
+    }
+    void **aligned = (void **)(((size_t)raw + sizeof(void *) + alignment - 1) & ~(size_t)(alignment - 1));
+    aligned[-1] = raw;
+    return aligned;
+}
+
+void alignedFree(void *ptr) {
+    if (ptr) {
+        free(((void **)ptr)[-1]);
+    }
+}
+
+/**
+ * Helpers for images of any depth, the channel values of a row are loaded to and stored from floats.
+ */
+
+int depthSize(SCV_DEPTH depth) {
+    switch (depth) {
+    case SCV_DEPTH_16S:
+    case SCV_DEPTH_16U:
+        return 2;
+    case SCV_DEPTH_32F:
+        return 4;
+    case SCV_DEPTH_8U:
+    default:
+        return 1;
+    }
+}
+
+/**
+ * Channel values from lo to lo + span map to black to white.
+ */
+void depthRange(SCV_DEPTH depth, float *lo, float *span) {
+    switch (depth) {
+    case SCV_DEPTH_16S:
+        *lo = -32768.0f;
+        *span = 65536.0f;
+        break;
+    case SCV_DEPTH_16U:
+        *lo = 0.0f;
+        *span = 65536.0f;
+        break;
+    case SCV_DEPTH_32F:
+        *lo = 0.0f;
+        *span = 1.0f;
+        break;
+    case SCV_DEPTH_8U:
+    default:
+        *lo = 0.0f;
+        *span = 256.0f;
+        break;
+    }
+}
+
+void loadValuesF(SCV_DEPTH depth, const void *row, float *dst, int n) {
+    switch (depth) {
+    case SCV_DEPTH_16S:
+        for (int i = 0; i < n; i++) {
+            dst[i] = ((const short *)row)[i];
+        }
+        break;
+    case SCV_DEPTH_16U:
+        for (int i = 0; i < n; i++) {
+            dst[i] = ((const unsigned short *)row)[i];
+        }
+        break;
+    case SCV_DEPTH_32F:
+        memcpy(dst, row, n * sizeof(float));
+        break;
+    case SCV_DEPTH_8U:
+    default:
+        for (int i = 0; i < n; i++) {
+            dst[i] = ((const ScvUByte *)row)[i];
+        }
+        break;
+    }
+}
+
+/**
+ * Integer depths are rounded and saturated.
+ */
+void storeValuesF(SCV_DEPTH depth, const float *src, void *row, int n) {
+    switch (depth) {
+    case SCV_DEPTH_16S:
+        for (int i = 0; i < n; i++) {
+            float v = floorf(src[i] + 0.5f);
+            ((short *)row)[i] = (short)MIN(MAX(v, -32768.0f), 32767.0f);
+        }
+        break;
+    case SCV_DEPTH_16U:
+        for (int i = 0; i < n; i++) {
+            float v = floorf(src[i] + 0.5f);
+            ((unsigned short *)row)[i] = (unsigned short)MIN(MAX(v, 0.0f), 65535.0f);
+        }
+        break;
+    case SCV_DEPTH_32F:
+        memcpy(row, src, n * sizeof(float));
+        break;
+    case SCV_DEPTH_8U:
+    default:
+        for (int i = 0; i < n; i++) {
+            float v = floorf(src[i] + 0.5f);
+            ((ScvUByte *)row)[i] = (ScvUByte)MIN(MAX(v, 0.0f), 255.0f);
+        }
+        break;
+    }
+}
+
+/**
+ * Maps channel values from the range of one depth to the range of another, see depthRange.
+ */
+void rescaleValuesF(SCV_DEPTH from, SCV_DEPTH to, float *values, int n) {
+    if (from == to) {
+        return;
+    }
+    float fromLo, fromSpan, toLo, toSpan;
+    depthRange(from, &fromLo, &fromSpan);
+    depthRange(to, &toLo, &toSpan);
+    const float scale = toSpan / fromSpan;
+    for (int i = 0; i < n; i++) {
+        values[i] = (values[i] - fromLo) * scale + toLo;
+    }
+}
+
+void loadRowF(const ScvImage *image, int y, float *dst) {
+    loadValuesF(image->depth, scvGetRowRef(image, y), dst, image->width * 3);
+}
+
+void storeRowF(ScvImage *image, int y, const float *src) {
+    storeValuesF(image->depth, src, scvGetRowRef(image, y), image->width * 3);
+}
+
+/**
+ * Same as grayValueOfPixel, without rounding.
+ */
+float grayValueF(const float *bgr, SCV_GRAYING_TYPE type) {
+    switch (type) {
+    case SCV_GRAYING_R:
+        return bgr[2];
+    case SCV_GRAYING_G:
+        return bgr[1];
+    case SCV_GRAYING_B:
+        return bgr[0];
+    case SCV_GRAYING_MAX:
+        return MAX(MAX(bgr[0], bgr[1]), bgr[2]);
+    case SCV_GRAYING_AVG:
+        return (bgr[0] + bgr[1] + bgr[2]) / 3.0f;
+    case SCV_GRAYING_W_AVG:
+    default:
+        return 0.30f * bgr[2] + 0.59f * bgr[1] + 0.11f * bgr[0];
+    }
+}
+
+/**
+ * Histogram bin of a gray value, 256 bins evenly cover the range of the depth.
+ */
+int histBinF(float value, float lo, float span) {
+    int bin = (int)floorf((value - lo) * 256.0f / span);
+    return MIN(MAX(bin, 0), 255);
+}
+
+float medianF(int count, float *num) {
+    for (int i = 1; i < count; i++) {
+        float cur = num[i];
+        int j = i - 1;
+        for (; j >= 0 && num[j] > cur; j--) {
+            num[j + 1] = num[j];
+        }
+        num[j + 1] = cur;
+    }
+    return count % 2 ? num[count / 2] : (num[count / 2 - 1] + num[count / 2]) / 2.0f;
+}
+
+/**
+ * 3x3 smoothing of any depth, with the same border handling as smoothRect.
+ * Source rows are kept in a ring of 3 float rows, so src may be dst.
+ */
+void smoothRowsF(const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type) {
+    const int w = src->width;
+    const int h = src->height;
+    const int n = w * 3;
+    const int gaussianWeight[3] = {1, 2, 1};
+
+    float *ring = (float *)malloc(sizeof(float) * n * 4);
+    float *out = ring + n * 3;
+    if (h > 0) {
+        loadRowF(src, 0, ring);
+    }
+    for (int y = 0; y < h; y++) {
+        if (y + 1 < h) {
+            loadRowF(src, y + 1, ring + (y + 1) % 3 * n);
+        }
+
+        for (int x = 0; x < w; x++) {
+            for (int c = 0; c < 3; c++) {
+                float values[9];
+                float sum = 0.0f, weightSum = 0.0f;
+                int count = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    if (y + dy < 0 || y + dy >= h) {
+                        continue;
+                    }
+                    const float *row = ring + (y + dy + 3) % 3 * n;
+                    for (int dx = -1; dx <= 1; dx++) {
+                        if (x + dx < 0 || x + dx >= w) {
+                            continue;
+                        }
+                        const float v = row[(x + dx) * 3 + c];
+                        const int weight =
+                            SCV_SMOOTH_GAUSSIAN == type ? gaussianWeight[dx + 1] * gaussianWeight[dy + 1] : 1;
+                        values[count++] = v;
+                        sum += v * weight;
+                        weightSum += weight;
+                    }
+                }
+                out[x * 3 + c] = SCV_SMOOTH_MEDIAN == type ? medianF(count, values) : sum / weightSum;
+            }
+        }
+        rescaleValuesF(src->depth, dst->depth, out, n);
+        storeRowF(dst, y, out);
+    }
+    free(ring);
+}
+
+/**
+ * The fill pixel of the warps in the given depth, scaled from 0-255 to the range of the depth.
+ * fill must hold a pixel of the depth.
+ */
+void depthFillPixel(SCV_DEPTH depth, ScvPixel fillPxl, void *fill) {
+    float lo, span;
+    depthRange(depth, &lo, &span);
+    const float scale = (SCV_DEPTH_32F == depth ? span : span - 1.0f) / 255.0f;
+    float fillF[3] = {lo + fillPxl.b * scale, lo + fillPxl.g * scale, lo + fillPxl.r * scale};
+    storeValuesF(depth, fillF, fill, 3);
+}
+
+SCV_INLINE const ScvUByte *pixelOrFill(const ScvImage *image, int x, int y, int pixelBytes, const ScvUByte *fill) {
+    if (x < 0 || x >= image->width || y < 0 || y >= image->height) {
+        return fill;
+    }
+    return (const ScvUByte *)scvGetRowRef(image, y) + x * pixelBytes;
+}
+
+/**
+ * Samples src at (fx, fy), pixel centers are at integer + 0.5 like the warps,
+ * and stores the pixel in the depth of src to out. Pixels outside of src are fill.
+ */
+void samplePixel(const ScvImage *src, float fx, float fy, SCV_INTERPOLATION interpolation, const ScvUByte *fill,
+                 int pixelBytes, ScvUByte *out) {
+    if (SCV_INTER_NEAREST == interpolation) {
+        // Compared as floats first, so that far away points never overflow the conversion
+        const int inside = fx >= 0.0f && fx < src->width && fy >= 0.0f && fy < src->height;
+        const ScvUByte *pxl = inside ? pixelOrFill(src, (int)fx, (int)fy, pixelBytes, fill) : fill;
+        memcpy(out, pxl, (size_t)pixelBytes);
+        return;
+    }
+
+    const float gx = fx - 0.5f;
+    const float gy = fy - 0.5f;
+    if (!(gx > -1.0f && gx < src->width && gy > -1.0f && gy < src->height)) {
+        memcpy(out, fill, (size_t)pixelBytes);
+        return;
+    }
+    const int x0 = (int)floorf(gx);
+    const int y0 = (int)floorf(gy);
+    const float ax = gx - x0;
+    const float ay = gy - y0;
+    const ScvUByte *p00 = pixelOrFill(src, x0, y0, pixelBytes, fill);
+    const ScvUByte *p01 = pixelOrFill(src, x0 + 1, y0, pixelBytes, fill);
+    const ScvUByte *p10 = pixelOrFill(src, x0, y0 + 1, pixelBytes, fill);
+    const ScvUByte *p11 = pixelOrFill(src, x0 + 1, y0 + 1, pixelBytes, fill);
+
+    if (SCV_DEPTH_8U == src->depth) {
+        // 8-bit weights, the products have 16 fraction bits
+        const int wx = (int)(ax * 256.0f + 0.5f);
+        const int wy = (int)(ay * 256.0f + 0.5f);
+        const int w00 = (256 - wx) * (256 - wy), w01 = wx * (256 - wy), w10 = (256 - wx) * wy, w11 = wx * wy;
+        for (int c = 0; c < 3; c++) {
+            out[c] = (ScvUByte)((p00[c] * w00 + p01[c] * w01 + p10[c] * w10 + p11[c] * w11 + (1 << 15)) >> 16);
+        }
+        return;
+    }
+
+    float v00[3], v01[3], v10[3], v11[3], result[3];
+    loadValuesF(src->depth, p00, v00, 3);
+    loadValuesF(src->depth, p01, v01, 3);
+    loadValuesF(src->depth, p10, v10, 3);
+    loadValuesF(src->depth, p11, v11, 3);
+    for (int c = 0; c < 3; c++) {
+        const float top = v00[c] + (v01[c] - v00[c]) * ax;
+        const float bottom = v10[c] + (v11[c] - v10[c]) * ax;
+        result[c] = top + (bottom - top) * ay;
+    }
+    storeValuesF(src->depth, result, out, 3);
+}
+
+// Fixed-point map coordinates are clamped to this, far enough outside of any source
+#define MAP_COORD_LIMIT 32000.0f
+
+/**
+ * Stores the source point (fx, fy) as the map entry i, rounded to SCV_MAP_BITS fraction bits,
+ * so that a point on a pixel center has zero fractions and samples that pixel exactly.
+ */
+SCV_INLINE void setMapEntry(ScvMap *map, size_t i, float fx, float fy) {
+    const float scale = (float)(1 << SCV_MAP_BITS);
+    const int gx = (int)floorf(MIN(MAX(fx - 0.5f, -MAP_COORD_LIMIT), MAP_COORD_LIMIT) * scale + 0.5f);
+    const int gy = (int)floorf(MIN(MAX(fy - 0.5f, -MAP_COORD_LIMIT), MAP_COORD_LIMIT) * scale + 0.5f);
+    const int mask = (1 << SCV_MAP_BITS) - 1;
+    map->coords[i * 2] = (short)(gx >> SCV_MAP_BITS);
+    map->coords[i * 2 + 1] = (short)(gy >> SCV_MAP_BITS);
+    map->fractions[i] = (unsigned short)((gy & mask) << SCV_MAP_BITS | (gx & mask));
+}
+
+/**
+ * Remaps a destination row of an 8-bit image, the taps inside of src are read without bound checks.
+ */
+void remapRow8U(const ScvImage *src, const ScvMap *map, int y, SCV_INTERPOLATION interpolation,
+                const ScvUByte *fill, ScvUByte *out) {
+    const short *coords = map->coords + (size_t)y * map->width * 2;
+    const unsigned short *fractions = map->fractions + (size_t)y * map->width;
+    const int mask = (1 << SCV_MAP_BITS) - 1;
+    const int one = 1 << SCV_MAP_BITS;
+    const int half = 1 << (SCV_MAP_BITS - 1);
+    for (int x = 0; x < map->width; x++, out += 3) {
+        const int x0 = coords[x * 2], y0 = coords[x * 2 + 1];
+        const int ax = fractions[x] & mask, ay = fractions[x] >> SCV_MAP_BITS;
+        if (SCV_INTER_NEAREST == interpolation) {
+            // The pixel whose center is nearest to the rounded point
+            const ScvUByte *pxl = pixelOrFill(src, x0 + (ax >= half), y0 + (ay >= half), 3, fill);
+            out[0] = pxl[0];
+            out[1] = pxl[1];
+            out[2] = pxl[2];
+            continue;
+        }
+
+        const ScvUByte *p00, *p01, *p10, *p11;
+        if (x0 >= 0 && y0 >= 0 && x0 + 1 < src->width && y0 + 1 < src->height) {
+            p00 = (const ScvUByte *)scvGetRowRef(src, y0) + x0 * 3;
+            p10 = (const ScvUByte *)scvGetRowRef(src, y0 + 1) + x0 * 3;
+            p01 = p00 + 3;
+            p11 = p10 + 3;
+        } else {
+            p00 = pixelOrFill(src, x0, y0, 3, fill);
+            p01 = pixelOrFill(src, x0 + 1, y0, 3, fill);
+            p10 = pixelOrFill(src, x0, y0 + 1, 3, fill);
+            p11 = pixelOrFill(src, x0 + 1, y0 + 1, 3, fill);
+        }
+        const int w00 = (one - ax) * (one - ay), w01 = ax * (one - ay);
+        const int w10 = (one - ax) * ay, w11 = ax * ay;
+        const int shift = SCV_MAP_BITS * 2;
+        for (int c = 0; c < 3; c++) {
+            const int sum = p00[c] * w00 + p01[c] * w01 + p10[c] * w10 + p11[c] * w11;
+            out[c] = (ScvUByte)((sum + (1 << (shift - 1))) >> shift);
+        }
+    }
+}
+
+SCV_INLINE void copyPixelBytes(ScvUByte *dst, const ScvUByte *src, int pixelBytes) {
+    // Constant sizes, so that the copies are plain moves
+    switch (pixelBytes) {
+    case 3:
+        memcpy(dst, src, 3);
+        break;
+    case 6:
+        memcpy(dst, src, 6);
+        break;
+    default:
+        memcpy(dst, src, 12);
+        break;
+    }
+}
+
+SCV_INLINE void swapPixelBytes(ScvUByte *a, ScvUByte *b, int pixelBytes) {
+    ScvUByte t[12];
+    copyPixelBytes(t, a, pixelBytes);
+    copyPixelBytes(a, b, pixelBytes);
+    copyPixelBytes(b, t, pixelBytes);
+}
+
+void swapBytes(ScvUByte *a, ScvUByte *b, size_t n) {
+    ScvUByte t[256];
+    for (size_t i = 0; i < n; i += sizeof(t)) {
+        const size_t chunk = MIN(sizeof(t), n - i);
+        memcpy(t, a + i, chunk);
+        memcpy(a + i, b + i, chunk);
+        memcpy(b + i, t, chunk);
+    }
+}
+
+/**
+ * Mirrors a row of pixels, src may be dst.
+ */
+void reverseRow(const ScvUByte *src, ScvUByte *dst, int width, int pixelBytes) {
+    if (src == dst) {
+        for (int i = 0, j = width - 1; i < j; i++, j--) {
+            swapPixelBytes(dst + i * pixelBytes, dst + j * pixelBytes, pixelBytes);
+        }
+        return;
+    }
+    for (int i = 0; i < width; i++) {
+        copyPixelBytes(dst + i * pixelBytes, src + (width - 1 - i) * pixelBytes, pixelBytes);
+    }
+}
+
+/**
+ * Side of the square tiles of the transposes, a source and a destination tile fit in L1 for every depth.
+ */
+int transposeTileSize(int pixelBytes) {
+    return pixelBytes <= 3 ? 64 : 32;
+}
+
+/**
+ * dst(x, y) = src(y, x), with the source x reversed if reverseX and the source y reversed if reverseY.
+ * Done tile by tile, so that the column walk of one of the images stays in cache.
+ */
+void transposeTiles(const ScvImage *src, ScvImage *dst, int reverseX, int reverseY) {
+    const int pixelBytes = 3 * depthSize(src->depth);
+    const int tile = transposeTileSize(pixelBytes);
+    const ScvUByte **srcRows = (const ScvUByte **)malloc(sizeof(ScvUByte *) * src->height);
+    for (int y = 0; y < src->height; y++) {
+        srcRows[y] = (const ScvUByte *)scvGetRowRef(src, y);
+    }
+
+    int ty;
+#pragma omp parallel for schedule(static)
+    for (ty = 0; ty < dst->height; ty += tile) {
+        const int yEnd = MIN(ty + tile, dst->height);
+        for (int tx = 0; tx < dst->width; tx += tile) {
+            const int xEnd = MIN(tx + tile, dst->width);
+            for (int y = ty; y < yEnd; y++) {
+                ScvUByte *dstRow = (ScvUByte *)scvGetRowRef(dst, y);
+                const int sx = reverseX ? src->width - 1 - y : y;
+                for (int x = tx; x < xEnd; x++) {
+                    const int sy = reverseY ? src->height - 1 - x : x;
+                    copyPixelBytes(dstRow + x * pixelBytes, srcRows[sy] + sx * pixelBytes, pixelBytes);
+                }
+            }
+        }
+    }
+    free(srcRows);
+}
+
+/**
+ * Transposes a square image in place, swapping the tiles above the diagonal with the ones below.
+ */
+void transposeSquare(ScvImage *image) {
+    const int n = image->width;
+    const int pixelBytes = 3 * depthSize(image->depth);
+    const int tile = transposeTileSize(pixelBytes);
+
+    int ty;
+#pragma omp parallel for schedule(dynamic)
+    for (ty = 0; ty < n; ty += tile) {
+        for (int tx = ty; tx < n; tx += tile) {
+            for (int y = ty; y < MIN(ty + tile, n); y++) {
+                ScvUByte *row = (ScvUByte *)scvGetRowRef(image, y);
+                for (int x = MAX(tx, y + 1); x < MIN(tx + tile, n); x++) {
+                    ScvUByte *mirror = (ScvUByte *)scvGetRowRef(image, x) + y * pixelBytes;
+                    swapPixelBytes(row + x * pixelBytes, mirror, pixelBytes);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Swaps row y with row h - 1 - y for the top half, mirroring them too if reverse.
+ */
+void flipRows(const ScvImage *src, ScvImage *dst, int reverse) {
+    const int h = src->height;
+    const int pixelBytes = 3 * depthSize(src->depth);
+    const size_t rowBytes = (size_t)src->width * pixelBytes;
+
+    int y;
+#pragma omp parallel for schedule(static)
+    for (y = 0; y < (h + 1) / 2; y++) {
+        const ScvUByte *srcA = (const ScvUByte *)scvGetRowRef(src, y);
+        const ScvUByte *srcB = (const ScvUByte *)scvGetRowRef(src, h - 1 - y);
+        ScvUByte *dstA = (ScvUByte *)scvGetRowRef(dst, y);
+        ScvUByte *dstB = (ScvUByte *)scvGetRowRef(dst, h - 1 - y);
+        if (src != dst) {
+            if (reverse) {
+                reverseRow(srcB, dstA, src->width, pixelBytes);
+                reverseRow(srcA, dstB, src->width, pixelBytes);
+            } else {
+                memcpy(dstA, srcB, rowBytes);
+                memcpy(dstB, srcA, rowBytes);
+            }
+            continue;
+        }
+
+        if (reverse) {
+            reverseRow(dstA, dstA, src->width, pixelBytes);
+            if (dstA != dstB) {
+                reverseRow(dstB, dstB, src->width, pixelBytes);
+            }
+        }
+        if (dstA != dstB) {
+            swapBytes(dstA, dstB, rowBytes);
+        }
+    }
+}
+
+/**
+ * Inverse of a 2x3 affine matrix extended to 3x3 with the last row 0 0 1.
+ */
+void invertAffine(const ScvMat *mat, float *mInv) {
+    float m[9];
+    for (int i = 0; i < 6; i++) {
+        m[i] = mat->data[i];
+    }
+    ScvMat stdMat = scvMat(3, 3, m);
+    scvMatSetVal(&stdMat, 2, 0, 0.0f);
+    scvMatSetVal(&stdMat, 2, 1, 0.0f);
+    scvMatSetVal(&stdMat, 2, 2, 1.0f);
+
+    ScvMat stdMatInv = scvMat(3, 3, mInv);
+    scvMatInverse(&stdMat, &stdMatInv);
+}
+
+/**
+ * scvWarpAffine with the inverse of its matrix (3x3, the last row 0 0 1) already calculated.
+ */
+void warpAffineInverse(const ScvImage *src, ScvImage *dst, const float *mInv, ScvPixel fillPxl) {
+    ScvUByte fill[12];
+    depthFillPixel(dst->depth, fillPxl, fill);
+    const int pixelBytes = 3 * depthSize(dst->depth);
+
+    /**
+     * In place, a destination row is built in a separate buffer,
+     * and the source row it replaces is kept only if a later destination row still reads it.
+     * lastLo[y] and lastHi[y] bound the source rows read by destination rows y and after.
+     */
+    const int inPlace = src == dst;
+    const int h = dst->height;
+    ScvUByte *out = NULL;
+    ScvUByte **saved = NULL;
+    int *lastLo = NULL, *lastHi = NULL;
+    if (inPlace) {
+        out = (ScvUByte *)malloc((size_t)dst->width * pixelBytes);
+        saved = (ScvUByte **)calloc((size_t)h, sizeof(ScvUByte *));
+        lastLo = (int *)malloc(sizeof(int) * (h + 1));
+        lastHi = (int *)malloc(sizeof(int) * (h + 1));
+        lastLo[h] = src->height;
+        lastHi[h] = -1;
+        for (int iy = h - 1; iy >= 0; iy--) {
+            // The source row is linear in x, so the ends of the row bound it, plus 1 for rounding
+            float fy0 = mInv[3] * 0.5f + mInv[4] * (iy + 0.5f) + mInv[5];
+            float fy1 = mInv[3] * (dst->width - 0.5f) + mInv[4] * (iy + 0.5f) + mInv[5];
+            lastLo[iy] = MIN(lastLo[iy + 1], (int)floorf(MIN(fy0, fy1)) - 1);
+            lastHi[iy] = MAX(lastHi[iy + 1], (int)floorf(MAX(fy0, fy1)) + 1);
+        }
+    }
+    int freeFrom = 0;
+
+    // Traverse the destination image
+    for (int iy = 0; iy < h; iy++) {
+        ScvUByte *dstRow = inPlace ? out : (ScvUByte *)scvGetRowRef(dst, iy);
+        for (int ix = 0; ix < dst->width; ix++) {
+            /**
+             * Calculate the origin point of
+             * the current point on new image,
+             * and fill the empty pixels using
+             * Nearest Neighbor Interpolation algorithm.
+             */
+
+            float fxO = mInv[0] * (ix + 0.5f) + mInv[1] * (iy + 0.5f) + mInv[2];
+            float fyO = mInv[3] * (ix + 0.5f) + mInv[4] * (iy + 0.5f) + mInv[5];
+
+            fxO += fxO > 0 ? 0 : -0.5f;
+            fyO += fyO > 0 ? 0 : -0.5f;
+
+            const int xO = (int)fxO;
+            const int yO = (int)fyO;
+            const ScvUByte *pxl = fill;
+            if (xO >= 0 && xO < src->width && yO >= 0 && yO < src->height) {
+                const ScvUByte *srcRow = inPlace && yO < iy ? saved[yO] : (const ScvUByte *)scvGetRowRef(src, yO);
+                pxl = srcRow + xO * pixelBytes;
+            }
+            memcpy(dstRow + ix * pixelBytes, pxl, (size_t)pixelBytes);
+        }
+
+        if (inPlace) {
+            ScvUByte *row = (ScvUByte *)scvGetRowRef(dst, iy);
+            const size_t rowBytes = (size_t)dst->width * pixelBytes;
+            if (iy >= lastLo[iy + 1] && iy <= lastHi[iy + 1]) {
+                saved[iy] = (ScvUByte *)malloc(rowBytes);
+                memcpy(saved[iy], row, rowBytes);
+            }
+            memcpy(row, out, rowBytes);
+
+            // Rows above every later read are released
+            for (; freeFrom < MIN(lastLo[iy + 1], iy + 1); freeFrom++) {
+                free(saved[freeFrom]);
+                saved[freeFrom] = NULL;
+            }
+        }
+    }
+
+    if (inPlace) {
+        for (; freeFrom < h; freeFrom++) {
+            free(saved[freeFrom]);
+        }
+        free(out);
+        free(saved);
+        free(lastLo);
+        free(lastHi);
+    }
+}
+
 #pragma mark - Export
 
 #pragma mark-- Make
 
-ScvImage *scvCreateImage(ScvSize size) {
+ScvImage *scvCreateImage(ScvSize size) { return scvCreateImageWithDepth(size, SCV_DEPTH_8U); }
+
+ScvImage *scvCreateImageWithDepth(ScvSize size, SCV_DEPTH depth) {
+    // Row bytes, padding included, must fit an int
+    if (size.width < 0 || size.height < 0 || size.width > (INT_MAX - imageAlignment * 2) / (3 * depthSize(depth))) {
+        return NULL;
+    }
+    const int widthBytes = alignedWidthBytes(size.width * 3 * depthSize(depth), imageAlignment);
+    if (size.height > 0 && (size_t)widthBytes > (SIZE_MAX - imageAlignment - sizeof(void *)) / size.height) {
+        return NULL;
+    }
+
+    const size_t dataSize = (size_t)widthBytes * size.height;
     ScvImage *image = (ScvImage *)malloc(sizeof(ScvImage));
+    void *data = alignedMalloc(dataSize, imageAlignment);
+    if (NULL == image || NULL == data) {
+        free(image);
+        alignedFree(data);
+        return NULL;
+    }
     image->origin = 0;
     image->width = size.width;
     image->height = size.height;
-    const int realWidthBytes = image->width * 3;
-    image->widthBytes = realWidthBytes % 4 ? ((realWidthBytes >> 2) + 1) << 2 : realWidthBytes;
-    const int dataSize = image->widthBytes * image->height;
-    image->data = malloc((size_t)dataSize);
-    memset(image->data, 0, (size_t)dataSize);
+    image->depth = depth;
+    image->widthBytes = widthBytes;
+    image->data = data;
+    memset(image->data, 0, dataSize);
     return image;
 }
 
 ScvImage *scvCloneImage(const ScvImage *image) {
-    ScvImage *result = scvCreateImage(scvGetSize(image));
-    scvCopyImage(image, result);
+    ScvImage *result = scvCreateImageWithDepth(scvGetSize(image), image->depth);
+    if (NULL != result) {
+        scvCopyImage(image, result);
+    }
     return result;
 }
 
 void scvCopyImage(const ScvImage *src, ScvImage *dst) {
+    if (src->depth != dst->depth) {
+        // Use scvConvertImage
+        return;
+    }
+
     dst->origin = src->origin;
     dst->width = src->width;
     dst->height = src->height;
-    dst->widthBytes = src->widthBytes;
-    memcpy(dst->data, src->data, (size_t)(src->widthBytes * src->height));
+
+    // Strides may differ, e.g. when the alignment changed in between
+    if (dst->widthBytes == src->widthBytes) {
+        memcpy(dst->data, src->data, (size_t)src->widthBytes * src->height);
+    } else {
+        for (int i = 0; i < src->height; i++) {
+            memcpy((char *)dst->data + i * dst->widthBytes, (const char *)src->data + i * src->widthBytes,
+                   (size_t)src->width * 3 * depthSize(src->depth));
+        }
+    }
 }
 
 void scvReleaseImage(ScvImage *image) {
-    free(image->data);
+    alignedFree(image->data);
     free(image);
 }
 
@@ -250,8 +1306,77 @@ void scvReleaseHist(ScvHistogram *histogram) {
     free(histogram);
 }
 
+ScvDirtyMap *scvCreateDirtyMap(ScvSize size, int blockSize) {
+    ScvDirtyMap *map = (ScvDirtyMap *)malloc(sizeof(ScvDirtyMap));
+    map->width = size.width;
+    map->height = size.height;
+    map->blockSize = MAX(blockSize, 4);
+    map->cols = (size.width + map->blockSize - 1) / map->blockSize;
+    map->rows = (size.height + map->blockSize - 1) / map->blockSize;
+    map->dirty = (ScvUByte *)malloc((size_t)map->cols * map->rows);
+    memset(map->dirty, 0, (size_t)map->cols * map->rows);
+    return map;
+}
+
+void scvReleaseDirtyMap(ScvDirtyMap *map) {
+    free(map->dirty);
+    free(map);
+}
+
+ScvCannyState *scvCreateCannyState(ScvSize size) {
+    const size_t count = (size_t)size.width * size.height;
+    ScvCannyState *state = (ScvCannyState *)malloc(sizeof(ScvCannyState));
+    state->width = size.width;
+    state->height = size.height;
+    state->filtered = scvCreateImage(size);
+    state->P = (short *)malloc(count * sizeof(short));
+    state->Q = (short *)malloc(count * sizeof(short));
+    state->M = (short *)malloc(count * sizeof(short));
+    state->N = (ScvUByte *)malloc(count);
+    state->E = (ScvUByte *)malloc(count);
+    memset(state->N, 0, count);
+    memset(state->hist, 0, sizeof(state->hist));
+    return state;
+}
+
+void scvReleaseCannyState(ScvCannyState *state) {
+    scvReleaseImage(state->filtered);
+    free(state->P);
+    free(state->Q);
+    free(state->M);
+    free(state->N);
+    free(state->E);
+    free(state);
+}
+
+ScvMap *scvCreateMap(ScvSize size) {
+    const size_t count = (size_t)size.width * size.height;
+    ScvMap *map = (ScvMap *)malloc(sizeof(ScvMap));
+    map->width = size.width;
+    map->height = size.height;
+    map->coords = (short *)malloc(sizeof(short) * count * 2);
+    map->fractions = (unsigned short *)malloc(sizeof(unsigned short) * count);
+    return map;
+}
+
+void scvReleaseMap(ScvMap *map) {
+    free(map->coords);
+    free(map->fractions);
+    free(map);
+}
+
 #pragma mark-- Getter and Setter
 
+void scvSetImageAlignment(int alignment) {
+    if (alignment >= 4 && 0 == (alignment & (alignment - 1))) {
+        imageAlignment = alignment;
+    }
+}
+
+int scvGetImageAlignment(void) { return imageAlignment; }
+
+int scvGetDepthSize(SCV_DEPTH depth) { return depthSize(depth); }
+
 ScvPixel *scvGetPixelRef(const ScvImage *image, int x, int y) {
     const int w = image->width;
     const int h = image->height;
@@ -266,6 +1391,16 @@ ScvPixel *scvGetPixelRef(const ScvImage *image, int x, int y) {
     return (ScvPixel *)((char *)image->data + (o ? h - 1 - y : y) * bW + x * 3);
 }
 
+ScvPixel *scvGetRowRef(const ScvImage *image, int y) {
+    const int h = image->height;
+
+    if (y < 0 || y >= h) {
+        return NULL;
+    }
+
+    return (ScvPixel *)((char *)image->data + (image->origin ? h - 1 - y : y) * image->widthBytes);
+}
+
 ScvPixel scvGetPixel(const ScvImage *image, int x, int y) {
     ScvPixel pixel = {0};
 
@@ -304,6 +1439,20 @@ ScvPoint scvGetCenter(const ScvImage *image) { return scvPoint(image->width / 2,
 
 void scvCalcHist(const ScvImage *image, ScvHistogram *hist) {
     memset(hist->val, 0, 256 * sizeof(int));
+    if (SCV_DEPTH_8U != image->depth) {
+        float lo, span;
+        depthRange(image->depth, &lo, &span);
+        float *row = (float *)malloc(sizeof(float) * image->width * 3);
+        for (int iy = 0; iy < image->height; iy++) {
+            loadRowF(image, iy, row);
+            for (int ix = 0; ix < image->width; ix++) {
+                hist->val[histBinF(grayValueF(row + ix * 3, hist->grayingType), lo, span)]++;
+            }
+        }
+        free(row);
+        return;
+    }
+
     for (int iy = 0; iy < image->height; iy++) {
         for (int ix = 0; ix < image->width; ix++) {
             ScvPixel pxl = scvGetPixel(image, ix, iy);
@@ -318,7 +1467,7 @@ void scvCalcHist(const ScvImage *image, ScvHistogram *hist) {
 #pragma mark-- Geometrical Transformation
 
 void scvWarpAffine(const ScvImage *src, ScvImage *dst, const ScvMat *mat, ScvPixel fillPxl) {
-    if (!(2 == mat->rows && 3 == mat->cols)) {
+    if (!(2 == mat->rows && 3 == mat->cols) || src->depth != dst->depth) {
         /**
          * Must be:
          * [ a b | c ]
@@ -327,60 +1476,242 @@ void scvWarpAffine(const ScvImage *src, ScvImage *dst, const ScvMat *mat, ScvPix
         return;
     }
 
-    int cloned = 0;
-    if (src == dst) {
-        src = scvCloneImage(dst);
-        cloned = 1;
+    float mInv[9];
+    invertAffine(mat, mInv);
+    warpAffineInverse(src, dst, mInv, fillPxl);
+}
+
+void scvWarpPerspective(const ScvImage *src, ScvImage *dst, const ScvMat *mat, SCV_INTERPOLATION interpolation,
+                        ScvPixel fillPxl) {
+    if (!(3 == mat->rows && 3 == mat->cols) || src->depth != dst->depth) {
+        return;
     }
 
-    scvFillImage(dst, fillPxl);
+    float mInv[9];
+    ScvMat matInv = scvMat(3, 3, mInv);
+    scvMatInverse(mat, &matInv);
 
-    float m[9];
-    for (int i = 0; i < 6; i++) {
-        m[i] = mat->data[i];
+    ScvUByte fill[12];
+    depthFillPixel(dst->depth, fillPxl, fill);
+    const int pixelBytes = 3 * depthSize(dst->depth);
+
+    // In place, the source is read from a copy
+    const ScvImage *source = src == dst ? scvCloneImage(src) : src;
+
+    int iy;
+#pragma omp parallel for schedule(static)
+    for (iy = 0; iy < dst->height; iy++) {
+        ScvUByte *dstRow = (ScvUByte *)scvGetRowRef(dst, iy);
+
+        /**
+         * The numerators and the denominator of the mapping are linear along a row,
+         * so they are stepped by the first column of the inverse, leaving one division per pixel.
+         * They are doubles so that the steps do not drift over wide rows.
+         */
+        double x = mInv[0] * 0.5 + mInv[1] * (iy + 0.5) + mInv[2];
+        double y = mInv[3] * 0.5 + mInv[4] * (iy + 0.5) + mInv[5];
+        double w = mInv[6] * 0.5 + mInv[7] * (iy + 0.5) + mInv[8];
+        for (int ix = 0; ix < dst->width; ix++) {
+            ScvUByte *out = dstRow + ix * pixelBytes;
+            if (0.0 != w) {
+                const double invW = 1.0 / w;
+                samplePixel(source, (float)(x * invW), (float)(y * invW), interpolation, fill, pixelBytes, out);
+            } else {
+                memcpy(out, fill, (size_t)pixelBytes);
+            }
+            x += mInv[0];
+            y += mInv[3];
+            w += mInv[6];
+        }
+    }
+
+    if (source != src) {
+        scvReleaseImage((ScvImage *)source);
+    }
+}
+
+void scvPerspectiveMatrix(const ScvPoint *srcQuad, const ScvPoint *dstQuad, ScvMat *mat) {
+    if (!(3 == mat->rows && 3 == mat->cols)) {
+        return;
+    }
+
+    /**
+     * u = (a x + b y + c) / (g x + h y + 1), v = (d x + e y + f) / (g x + h y + 1) for the 4 pairs,
+     * 8 linear equations of a ~ h, solved by Gaussian elimination with partial pivoting.
+     */
+    double system[8][9];
+    for (int i = 0; i < 4; i++) {
+        const double x = srcQuad[i].x, y = srcQuad[i].y;
+        const double u = dstQuad[i].x, v = dstQuad[i].y;
+        const double rowU[9] = {x, y, 1, 0, 0, 0, -x * u, -y * u, u};
+        const double rowV[9] = {0, 0, 0, x, y, 1, -x * v, -y * v, v};
+        memcpy(system[i * 2], rowU, sizeof(rowU));
+        memcpy(system[i * 2 + 1], rowV, sizeof(rowV));
+    }
+    for (int col = 0; col < 8; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < 8; row++) {
+            if (fabs(system[row][col]) > fabs(system[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (fabs(system[pivot][col]) < 1e-12) {
+            // Three of the points are collinear
+            return;
+        }
+        for (int k = 0; k < 9; k++) {
+            const double t = system[col][k];
+            system[col][k] = system[pivot][k];
+            system[pivot][k] = t;
+        }
+        for (int row = 0; row < 8; row++) {
+            if (row != col) {
+                const double factor = system[row][col] / system[col][col];
+                for (int k = col; k < 9; k++) {
+                    system[row][k] -= factor * system[col][k];
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        mat->data[i] = (float)(system[i][8] / system[i][i]);
+    }
+    mat->data[8] = 1.0f;
+}
+
+void scvBuildMap(ScvMap *map, const ScvMat *mat) {
+    if (!((2 == mat->rows || 3 == mat->rows) && 3 == mat->cols)) {
+        return;
     }
-    ScvMat stdMat = scvMat(3, 3, m);
-    scvMatSetVal(&stdMat, 2, 0, 0.0f);
-    scvMatSetVal(&stdMat, 2, 1, 0.0f);
-    scvMatSetVal(&stdMat, 2, 2, 1.0f);
 
+    float m[9] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    memcpy(m, mat->data, sizeof(float) * mat->rows * 3);
+    ScvMat stdMat = scvMat(3, 3, m);
     float mInv[9];
     ScvMat stdMatInv = scvMat(3, 3, mInv);
     scvMatInverse(&stdMat, &stdMatInv);
 
-    float pNew[3];
-    ScvMat stdPntNew = scvMat(3, 1, pNew);
-    scvMatSetVal(&stdPntNew, 2, 0, 1.0f);
+    int iy;
+#pragma omp parallel for schedule(static)
+    for (iy = 0; iy < map->height; iy++) {
+        // Stepped along the row like scvWarpPerspective
+        double x = mInv[0] * 0.5 + mInv[1] * (iy + 0.5) + mInv[2];
+        double y = mInv[3] * 0.5 + mInv[4] * (iy + 0.5) + mInv[5];
+        double w = mInv[6] * 0.5 + mInv[7] * (iy + 0.5) + mInv[8];
+        for (int ix = 0; ix < map->width; ix++) {
+            const double invW = 0.0 != w ? 1.0 / w : 0.0;
+            const float fx = 0.0 != w ? (float)(x * invW) : -MAP_COORD_LIMIT;
+            const float fy = 0.0 != w ? (float)(y * invW) : -MAP_COORD_LIMIT;
+            setMapEntry(map, (size_t)iy * map->width + ix, fx, fy);
+            x += mInv[0];
+            y += mInv[3];
+            w += mInv[6];
+        }
+    }
+}
 
-    float pOrig[3];
-    ScvMat stdPntOrig = scvMat(3, 1, pOrig);
+void scvBuildMapWithFunc(ScvMap *map, ScvMapFunc func, void *userData) {
+    for (int iy = 0; iy < map->height; iy++) {
+        for (int ix = 0; ix < map->width; ix++) {
+            float fx, fy;
+            func(ix + 0.5f, iy + 0.5f, &fx, &fy, userData);
+            setMapEntry(map, (size_t)iy * map->width + ix, fx, fy);
+        }
+    }
+}
 
-    // Traverse the destination image
-    for (int iy = 0; iy < dst->height; iy++) {
+void scvRemap(const ScvImage *src, ScvImage *dst, const ScvMap *map, SCV_INTERPOLATION interpolation,
+              ScvPixel fillPxl) {
+    if (dst->width != map->width || dst->height != map->height || src->depth != dst->depth) {
+        return;
+    }
+
+    ScvUByte fill[12];
+    depthFillPixel(dst->depth, fillPxl, fill);
+    const int pixelBytes = 3 * depthSize(dst->depth);
+    const ScvImage *source = src == dst ? scvCloneImage(src) : src;
+
+    int iy;
+#pragma omp parallel for schedule(static)
+    for (iy = 0; iy < dst->height; iy++) {
+        ScvUByte *dstRow = (ScvUByte *)scvGetRowRef(dst, iy);
+        if (SCV_DEPTH_8U == dst->depth) {
+            remapRow8U(source, map, iy, interpolation, fill, dstRow);
+            continue;
+        }
+
+        // Other depths go through the general sampler at the stored points
+        const float scale = 1.0f / (1 << SCV_MAP_BITS);
+        const int mask = (1 << SCV_MAP_BITS) - 1;
         for (int ix = 0; ix < dst->width; ix++) {
-            /**
-             * Calculate the origin point of
-             * the current point on new image,
-             * and fill the empty pixels using
-             * Nearest Neighbor Interpolation algorithm.
-             */
+            const size_t i = (size_t)iy * map->width + ix;
+            const float fx = map->coords[i * 2] + (map->fractions[i] & mask) * scale + 0.5f;
+            const float fy = map->coords[i * 2 + 1] + (map->fractions[i] >> SCV_MAP_BITS) * scale + 0.5f;
+            samplePixel(source, fx, fy, interpolation, fill, pixelBytes, dstRow + ix * pixelBytes);
+        }
+    }
+
+    if (source != src) {
+        scvReleaseImage((ScvImage *)source);
+    }
+}
 
-            scvMatSetVal(&stdPntNew, 0, 0, ix + 0.5f);
-            scvMatSetVal(&stdPntNew, 1, 0, iy + 0.5f);
+void scvFlip(const ScvImage *src, ScvImage *dst, SCV_FLIP_TYPE type) {
+    if (src->width != dst->width || src->height != dst->height || src->depth != dst->depth) {
+        return;
+    }
 
-            scvMatDotProduct(&stdMatInv, &stdPntNew, &stdPntOrig);
-            float fxO = scvMatGetVal(&stdPntOrig, 0, 0);
-            float fyO = scvMatGetVal(&stdPntOrig, 1, 0);
+    if (SCV_FLIP_VERTICAL == type) {
+        flipRows(src, dst, 0);
+        return;
+    }
 
-            fxO += fxO > 0 ? 0 : -0.5f;
-            fyO += fyO > 0 ? 0 : -0.5f;
+    const int pixelBytes = 3 * depthSize(src->depth);
+    int y;
+#pragma omp parallel for schedule(static)
+    for (y = 0; y < src->height; y++) {
+        reverseRow((const ScvUByte *)scvGetRowRef(src, y), (ScvUByte *)scvGetRowRef(dst, y), src->width, pixelBytes);
+    }
+}
+
+void scvTranspose(const ScvImage *src, ScvImage *dst) {
+    if (src->width != dst->height || src->height != dst->width || src->depth != dst->depth) {
+        return;
+    }
+
+    if (src == dst) {
+        transposeSquare(dst);
+    } else {
+        transposeTiles(src, dst, 0, 0);
+    }
+}
+
+void scvRotate90(const ScvImage *src, ScvImage *dst, int times) {
+    times = (times % 4 + 4) % 4;
+    const int swapped = times % 2;
+    if ((swapped ? src->height : src->width) != dst->width || (swapped ? src->width : src->height) != dst->height
+        || src->depth != dst->depth) {
+        return;
+    }
 
-            scvSetPixel(dst, ix, iy, scvGetPixel(src, (int)fxO, (int)fyO));
+    switch (times) {
+    case 0:
+        if (src != dst) {
+            scvCopyImage(src, dst);
+        }
+        break;
+    case 2:
+        flipRows(src, dst, 1);
+        break;
+    default:
+        // Counterclockwise reads the source columns from the right, clockwise reads the rows from the bottom
+        if (src != dst) {
+            transposeTiles(src, dst, 1 == times, 3 == times);
+        } else {
+            transposeSquare(dst);
+            scvFlip(dst, dst, 1 == times ? SCV_FLIP_VERTICAL : SCV_FLIP_HORIZONTAL);
         }
-    }
-
-    if (cloned) {
-        scvReleaseImage((ScvImage *)src);
+        break;
     }
 }
 
@@ -465,6 +1796,9 @@ void scvFlipMatrix(ScvPoint center, SCV_FLIP_TYPE type, ScvMat *mat) {
 #pragma mark-- Point Transformation
 
 void scvFillImage(ScvImage *image, ScvPixel fillPxl) {
+    if (SCV_DEPTH_8U != image->depth) {
+        return;
+    }
     for (int iy = 0; iy < image->height; iy++) {
         for (int ix = 0; ix < image->width; ix++) {
             scvSetPixel(image, ix, iy, fillPxl);
@@ -473,40 +1807,28 @@ void scvFillImage(ScvImage *image, ScvPixel fillPxl) {
 }
 
 void scvGraying(const ScvImage *src, ScvImage *dst, SCV_GRAYING_TYPE type) {
-    for (int iy = 0; iy < src->height; iy++) {
-        for (int ix = 0; ix < src->width; ix++) {
-            ScvPixel sPxl = scvGetPixel(src, ix, iy);
-            ScvPixel *dPxlRef = scvGetPixelRef(dst, ix, iy);
-            if (NULL != dPxlRef) {
-                int value = grayValueOfPixel(sPxl, type);
-                if (value >= 0 && value < 256) {
-                    dPxlRef->b = dPxlRef->g = dPxlRef->r = (ScvUByte)value;
-                }
-            }
-        }
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        return;
     }
+    grayingRect(src, dst, type, scvRect(0, 0, src->width, src->height));
 }
 
 void scvThreshold(const ScvImage *src, ScvImage *dst, SCV_GRAYING_TYPE grayingType) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        return;
+    }
     ScvHistogram *hist = scvCreateHist(grayingType);
     scvCalcHist(src, hist);
     float thresh = thresholdOtsu(hist, src->width * src->height);
     scvReleaseHist(hist);
-    for (int iy = 0; iy < src->height; iy++) {
-        for (int ix = 0; ix < src->width; ix++) {
-            ScvPixel sPxl = scvGetPixel(src, ix, iy);
-            ScvPixel *dPxlRef = scvGetPixelRef(dst, ix, iy);
-            if (NULL != dPxlRef) {
-                int value = grayValueOfPixel(sPxl, grayingType);
-                if (value >= 0 && value < 256) {
-                    dPxlRef->b = dPxlRef->g = dPxlRef->r = (ScvUByte)(value > thresh ? 255 : 0);
-                }
-            }
-        }
-    }
+    thresholdRect(src, dst, grayingType, thresh, scvRect(0, 0, src->width, src->height));
 }
 
 void scvSplit(const ScvImage *src, ScvImage *b, ScvImage *g, ScvImage *r) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != b->depth || SCV_DEPTH_8U != g->depth
+        || SCV_DEPTH_8U != r->depth) {
+        return;
+    }
     for (int iy = 0; iy < src->height; iy++) {
         for (int ix = 0; ix < src->width; ix++) {
             ScvPixel sPxl = scvGetPixel(src, ix, iy);
@@ -518,6 +1840,9 @@ void scvSplit(const ScvImage *src, ScvImage *b, ScvImage *g, ScvImage *r) {
 }
 
 void scvInverse(const ScvImage *src, ScvImage *dst) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        return;
+    }
     for (int iy = 0; iy < src->height; iy++) {
         for (int ix = 0; ix < src->width; ix++) {
             ScvPixel sPxl = scvGetPixel(src, ix, iy);
@@ -538,6 +1863,28 @@ void scvEqualizeHist(const ScvImage *src, const ScvHistogram *hist, ScvImage *ds
     }
 
     const int pixelCount = src->width * src->height;
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        // Values are binned like scvCalcHist and equalized to the range of dst
+        float srcLo, srcSpan, dstLo, dstSpan;
+        depthRange(src->depth, &srcLo, &srcSpan);
+        depthRange(dst->depth, &dstLo, &dstSpan);
+        const float dstMax = SCV_DEPTH_32F == dst->depth ? dstSpan : dstSpan - 1.0f;
+        float *row = (float *)malloc(sizeof(float) * src->width * 3 * 2);
+        float *out = row + src->width * 3;
+        for (int iy = 0; iy < src->height; iy++) {
+            loadRowF(src, iy, row);
+            loadRowF(dst, iy, out);
+            for (int ix = 0; ix < src->width; ix++) {
+                const int bin = histBinF(grayValueF(row + ix * 3, hist->grayingType), srcLo, srcSpan);
+                const float newVal = dstLo + ((float)cdf[bin] - cdfMin) / (pixelCount - cdfMin) * dstMax;
+                out[ix * 3] = out[ix * 3 + 1] = out[ix * 3 + 2] = newVal;
+            }
+            storeRowF(dst, iy, out);
+        }
+        free(row);
+        return;
+    }
+
     for (int iy = 0; iy < src->height; iy++) {
         for (int ix = 0; ix < src->width; ix++) {
             int value = grayValueOfPixel(scvGetPixel(src, ix, iy), hist->grayingType);
@@ -552,303 +1899,302 @@ void scvEqualizeHist(const ScvImage *src, const ScvHistogram *hist, ScvImage *ds
 }
 
 void scvSmooth(const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type) {
-    /**
-     * [i][0] -> dx;
-     * [i][1] -> dy;
-     */
-    int step[9][3] = {{-1, -1}, // Top-left
-                      {0, -1}, // Top
-                      {1, -1}, // Top-right
-                      {-1, 0}, // Left
-                      {0, 0}, // Center
-                      {1, 0}, // Right
-                      {-1, 1}, // Bottom-left
-                      {0, 1}, // Bottom
-                      {1, 1}}; // Bottom-right
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        smoothRowsF(src, dst, type);
+        return;
+    }
+    smoothRect(src, dst, type, scvRect(0, 0, src->width, src->height));
+}
 
-    // Weight template
-    int avgWeight[9] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
-    int gaussianWeight[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+void scvCanny(const ScvImage *image, ScvImage *path) {
+    if (SCV_DEPTH_8U != image->depth || SCV_DEPTH_8U != path->depth) {
+        return;
+    }
+    ScvCannyState *state = scvCreateCannyState(scvGetSize(image));
+    cannyRect(image, state, scvRect(0, 0, image->width, image->height));
+    cannyHysteresis(state, path);
+    scvReleaseCannyState(state);
+}
 
-    int *weight;
-    switch (type) {
-    case SCV_SMOOTH_GAUSSIAN:
-        weight = gaussianWeight;
-        break;
-    case SCV_SMOOTH_AVG:
-    case SCV_SMOOTH_MEDIAN:
-    default:
-        weight = avgWeight;
-        break;
+void scvAddWeighed(const ScvImage *src1, float alpha, const ScvImage *src2, float beta, ScvImage *dst) {
+    float rate = 1.0f / (alpha + beta);
+    alpha *= rate;
+    beta *= rate;
+
+    if (SCV_DEPTH_8U != src1->depth || SCV_DEPTH_8U != src2->depth || SCV_DEPTH_8U != dst->depth) {
+        // Blended in float in the range of dst and rounded once into dst
+        const int n = dst->width * 3;
+        float *row1 = (float *)malloc(sizeof(float) * (MAX(n, src1->width * 3) + MAX(n, src2->width * 3) + n));
+        float *row2 = row1 + MAX(n, src1->width * 3);
+        float *out = row2 + MAX(n, src2->width * 3);
+        for (int iy = 0; iy < dst->height; iy++) {
+            const int n1 = iy < src1->height ? MIN(src1->width * 3, n) : 0;
+            const int n2 = iy < src2->height ? MIN(src2->width * 3, n) : 0;
+            loadRowF(dst, iy, out);
+            if (n1 > 0) {
+                loadRowF(src1, iy, row1);
+                rescaleValuesF(src1->depth, dst->depth, row1, n1);
+            }
+            if (n2 > 0) {
+                loadRowF(src2, iy, row2);
+                rescaleValuesF(src2->depth, dst->depth, row2, n2);
+            }
+            for (int i = 0; i < n; i++) {
+                if (i < n1 && i < n2) {
+                    out[i] = alpha * row1[i] + beta * row2[i];
+                } else if (i < n1) {
+                    out[i] = row1[i];
+                } else if (i < n2) {
+                    out[i] = row2[i];
+                }
+            }
+            storeRowF(dst, iy, out);
+        }
+        free(row1);
+        return;
     }
 
-    int r, g, b;
-    int arrR[9], arrG[9], arrB[9];
-    int w[9];
+    for (int iy = 0; iy < dst->height; iy++) {
+        for (int ix = 0; ix < dst->width; ix++) {
+            if (ix < src1->width && iy < src1->height && ix < src2->width && iy < src2->height) {
+                // In range of both src1 and src2
+                ScvPixel pxl1 = scvGetPixel(src1, ix, iy);
+                ScvPixel pxl2 = scvGetPixel(src2, ix, iy);
+                scvSetPixel(dst,
+                            ix,
+                            iy,
+                            scvPixel((int)(alpha * pxl1.b + beta * pxl2.b),
+                                     (int)(alpha * pxl1.g + beta * pxl2.g),
+                                     (int)(alpha * pxl1.r + beta * pxl2.r)));
+            } else if (ix < src1->width && iy < src1->height) {
+                // In range of src1
+                scvSetPixel(dst, ix, iy, scvGetPixel(src1, ix, iy));
+            } else if (ix < src2->width && iy < src2->height) {
+                // In range of src2
+                scvSetPixel(dst, ix, iy, scvGetPixel(src2, ix, iy));
+            }
+        }
+    }
+}
+
+void scvConvertImage(const ScvImage *src, ScvImage *dst, float scale, float shift) {
+    if (src->width != dst->width || src->height != dst->height) {
+        return;
+    }
+
+    const int n = src->width * 3;
+    float *row = (float *)malloc(sizeof(float) * MAX(n, 1));
     for (int iy = 0; iy < src->height; iy++) {
-        for (int ix = 0; ix < src->width; ix++) {
-            int count = 0;
-            for (int i = 0; i < 9; i++) {
-                int curX = ix + step[i][0];
-                int curY = iy + step[i][1];
-                if (curX >= 0 && curX < src->width && curY >= 0 && curY < src->height) {
-                    ScvPixel pxl = scvGetPixel(src, curX, curY);
-                    arrR[count] = pxl.r;
-                    arrG[count] = pxl.g;
-                    arrB[count] = pxl.b;
-                    w[count] = weight[i];
-                    count++;
+        loadRowF(src, iy, row);
+        for (int i = 0; i < n; i++) {
+            row[i] = row[i] * scale + shift;
+        }
+        storeRowF(dst, iy, row);
+    }
+    free(row);
+}
+
+#pragma mark-- Batch
+
+void scvCannyBatch(ScvImage **images, ScvImage **paths, int count) {
+#pragma omp parallel
+    {
+        // Kept while the images have the same size
+        ScvCannyState *state = NULL;
+        int i;
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < count; i++) {
+            if (SCV_DEPTH_8U != images[i]->depth || SCV_DEPTH_8U != paths[i]->depth) {
+                continue;
+            }
+            const ScvSize size = scvGetSize(images[i]);
+            if (NULL != state && state->width == size.width && state->height == size.height) {
+                // Every candidate is rewritten over the whole image, only the histogram restarts
+                memset(state->hist, 0, sizeof(state->hist));
+            } else {
+                if (NULL != state) {
+                    scvReleaseCannyState(state);
                 }
+                state = scvCreateCannyState(size);
             }
+            cannyRect(images[i], state, scvRect(0, 0, size.width, size.height));
+            cannyHysteresis(state, paths[i]);
+        }
+        if (NULL != state) {
+            scvReleaseCannyState(state);
+        }
+    }
+}
 
-            switch (type) {
-            case SCV_SMOOTH_GAUSSIAN:
-            case SCV_SMOOTH_AVG:
-                r = (int)(avgArrWeighed(count, arrR, w) + 0.5f);
-                g = (int)(avgArrWeighed(count, arrG, w) + 0.5f);
-                b = (int)(avgArrWeighed(count, arrB, w) + 0.5f);
-                break;
-            case SCV_SMOOTH_MEDIAN:
-                r = (int)(medianArr(count, arrR) + 0.5f);
-                g = (int)(medianArr(count, arrG) + 0.5f);
-                b = (int)(medianArr(count, arrB) + 0.5f);
-                break;
-            default:
-                r = g = b = -1;
-                break;
-            }
-            if (r >= 0 && g >= 0 && b >= 0) {
-                scvSetPixel(dst, ix, iy, scvPixel(b, g, r));
+void scvThresholdBatch(ScvImage **srcs, ScvImage **dsts, int count, SCV_GRAYING_TYPE grayingType) {
+#pragma omp parallel
+    {
+        ScvHistogram *hist = scvCreateHist(grayingType);
+        int i;
+#pragma omp for schedule(dynamic)
+        for (i = 0; i < count; i++) {
+            const ScvImage *src = srcs[i];
+            if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dsts[i]->depth) {
+                continue;
             }
+            scvCalcHist(src, hist);
+            const float thresh = thresholdOtsu(hist, src->width * src->height);
+            thresholdRect(src, dsts[i], grayingType, thresh, scvRect(0, 0, src->width, src->height));
         }
+        scvReleaseHist(hist);
     }
 }
 
-void scvCanny(const ScvImage *image, ScvImage *path) {
-    // http://blog.csdn.net/likezhaobin/article/details/6892629
-    // The image is gray-scaled.
-    int i, j, ix, iy;
+void scvWarpAffineBatch(ScvImage **srcs, ScvImage **dsts, int count, const ScvMat *mat, ScvPixel fillPxl) {
+    if (!(2 == mat->rows && 3 == mat->cols)) {
+        return;
+    }
 
-    // Canny algorithm start
+    float mInv[9];
+    invertAffine(mat, mInv);
 
-    // Gaussian filter
-    ScvImage *filtered = scvCreateImage(scvGetSize(image));
-    scvSmooth(image, filtered, SCV_SMOOTH_GAUSSIAN);
+    int i;
+#pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < count; i++) {
+        if (srcs[i]->depth == dsts[i]->depth) {
+            warpAffineInverse(srcs[i], dsts[i], mInv, fillPxl);
+        }
+    }
+}
 
-    int nWidth = image->width;
-    int nHeight = image->height;
+#pragma mark-- Incremental
 
-    float *P = (float *)malloc(nWidth * nHeight * sizeof(float));
-    float *Q = (float *)malloc(nWidth * nHeight * sizeof(float));
-    int *M = (int *)malloc(nWidth * nHeight * sizeof(int));
-    float *theta = (float *)malloc(nWidth * nHeight * sizeof(float));
+void scvClearDirtyMap(ScvDirtyMap *map) { memset(map->dirty, 0, (size_t)map->cols * map->rows); }
 
-    for (iy = 0; iy < nHeight - 1; iy++) {
-        for (ix = 0; ix < nWidth - 1; ix++) {
-            P[iy * nWidth + ix] =
-                (scvGetPixel(filtered, MIN(ix + 1, nWidth - 1), iy).r - scvGetPixel(filtered, ix, iy).r
-                 + scvGetPixel(filtered, MIN(ix + 1, nWidth - 1), MIN(iy + 1, nHeight - 1)).r
-                 - scvGetPixel(filtered, ix, MIN(iy + 1, nHeight - 1)).r)
-                / 2.0f;
-            Q[iy * nWidth + ix] =
-                (scvGetPixel(filtered, ix, iy).r - scvGetPixel(filtered, ix, MIN(iy + 1, nHeight - 1)).r
-                 + scvGetPixel(filtered, MIN(ix + 1, nWidth - 1), iy).r
-                 - scvGetPixel(filtered, MIN(ix + 1, nWidth - 1), MIN(iy + 1, nHeight - 1)).r)
-                / 2.0f;
-        }
+void scvMarkDirty(ScvDirtyMap *map, ScvRect rect) {
+    rect = clipRect(rect, map->width, map->height);
+    if (0 == rect.width || 0 == rect.height) {
+        return;
     }
 
-    for (i = 0; i < nHeight; i++) {
-        for (j = 0; j < nWidth; j++) {
-            M[i * nWidth + j] =
-                (int)(sqrtf(P[i * nWidth + j] * P[i * nWidth + j] + Q[i * nWidth + j] * Q[i * nWidth + j]) + 0.5f);
-            theta[i * nWidth + j] = atan2f(Q[i * nWidth + j], Q[i * nWidth + j]) * 57.3f;
-            if (theta[i * nWidth + j] < 0) theta[i * nWidth + j] += 360;
+    const int bs = map->blockSize;
+    for (int by = rect.y / bs; by <= (rect.y + rect.height - 1) / bs; by++) {
+        for (int bx = rect.x / bs; bx <= (rect.x + rect.width - 1) / bs; bx++) {
+            map->dirty[by * map->cols + bx] = 1;
         }
     }
+}
 
-    ScvUByte *N = (ScvUByte *)malloc(nWidth * nHeight * sizeof(ScvUByte));
-    int g1 = 0, g2 = 0, g3 = 0, g4 = 0;
-    float dTmp1 = 0.0, dTmp2 = 0.0;
-    float dWeight;
+void scvMarkAllDirty(ScvDirtyMap *map) { memset(map->dirty, 1, (size_t)map->cols * map->rows); }
 
-    for (i = 0; i < nWidth; i++) {
-        N[i] = 0;
-        N[(nHeight - 1) * nWidth + i] = 0;
+int scvDiffFrames(const ScvImage *prev, const ScvImage *cur, int threshold, ScvDirtyMap *map) {
+    if (SCV_DEPTH_8U != prev->depth || SCV_DEPTH_8U != cur->depth) {
+        return 0;
     }
-    for (j = 0; j < nHeight; j++) {
-        N[j * nWidth] = 0;
-        N[j * nWidth + (nWidth - 1)] = 0;
-    }
-
-    for (i = 1; i < (nWidth - 1); i++) {
-        for (j = 1; j < (nHeight - 1); j++) {
-            int nPointIdx = i + j * nWidth;
-            if (M[nPointIdx] == 0) {
-                N[nPointIdx] = 0;
-            } else {
-                /////////////////////////////////////////////////////
-                /////////       g1  g2                  /////////////
-                /////////           C                   /////////////
-                /////////           g3  g4              /////////////
-                /////////////////////////////////////////////////////
-                if (((theta[nPointIdx] >= 90) && (theta[nPointIdx] < 135))
-                    || ((theta[nPointIdx] >= 270) && (theta[nPointIdx] < 315))) {
-                    g1 = M[nPointIdx - nWidth - 1];
-                    g2 = M[nPointIdx - nWidth];
-                    g3 = M[nPointIdx + nWidth];
-                    g4 = M[nPointIdx + nWidth + 1];
-                    dWeight = fabsf(P[nPointIdx]) / fabsf(Q[nPointIdx]);
-                    dTmp1 = g1 * dWeight + g2 * (1 - dWeight);
-                    dTmp2 = g4 * dWeight + g3 * (1 - dWeight);
-                }
-                /////////////////////////////////////////////////////
-                /////////       g1                      /////////////
-                /////////       g2  C   g3              /////////////
-                /////////               g4              /////////////
-                /////////////////////////////////////////////////////
-                else if (((theta[nPointIdx] >= 135) && (theta[nPointIdx] < 180))
-                         || ((theta[nPointIdx] >= 315) && (theta[nPointIdx] < 360))) {
-                    g1 = M[nPointIdx - nWidth - 1];
-                    g2 = M[nPointIdx - 1];
-                    g3 = M[nPointIdx + 1];
-                    g4 = M[nPointIdx + nWidth + 1];
-                    dWeight = fabsf(Q[nPointIdx]) / fabsf(P[nPointIdx]);
-                    dTmp1 = g2 * dWeight + g1 * (1 - dWeight);
-                    dTmp2 = g4 * dWeight + g3 * (1 - dWeight);
-                }
-                /////////////////////////////////////////////////////
-                /////////           g1  g2              /////////////
-                /////////           C                   /////////////
-                /////////       g4  g3                  /////////////
-                /////////////////////////////////////////////////////
-                else if (((theta[nPointIdx] >= 45) && (theta[nPointIdx] < 90))
-                         || ((theta[nPointIdx] >= 225) && (theta[nPointIdx] < 270))) {
-                    g1 = M[nPointIdx - nWidth];
-                    g2 = M[nPointIdx - nWidth + 1];
-                    g3 = M[nPointIdx + nWidth];
-                    g4 = M[nPointIdx + nWidth - 1];
-                    dWeight = fabsf(P[nPointIdx]) / fabsf(Q[nPointIdx]);
-                    dTmp1 = g2 * dWeight + g1 * (1 - dWeight);
-                    dTmp2 = g3 * dWeight + g4 * (1 - dWeight);
-                }
-                /////////////////////////////////////////////////////
-                /////////               g1              /////////////
-                /////////       g4  C   g2              /////////////
-                /////////       g3                      /////////////
-                /////////////////////////////////////////////////////
-                else if (((theta[nPointIdx] >= 0) && (theta[nPointIdx] < 45))
-                         || ((theta[nPointIdx] >= 180) && (theta[nPointIdx] < 225))) {
-                    g1 = M[nPointIdx - nWidth + 1];
-                    g2 = M[nPointIdx + 1];
-                    g3 = M[nPointIdx + nWidth - 1];
-                    g4 = M[nPointIdx - 1];
-                    dWeight = fabsf(Q[nPointIdx]) / fabsf(P[nPointIdx]);
-                    dTmp1 = g1 * dWeight + g2 * (1 - dWeight);
-                    dTmp2 = g3 * dWeight + g4 * (1 - dWeight);
+    const int bs = map->blockSize;
+    const int n = map->width * 3;
+    int *blockDiff = (int *)malloc(map->cols * sizeof(int));
+
+    int marked = 0;
+    for (int by = 0; by < map->rows; by++) {
+        ScvUByte *dirty = map->dirty + by * map->cols;
+        memset(blockDiff, 0, map->cols * sizeof(int));
+        for (int iy = by * bs; iy < MIN(by * bs + bs, map->height); iy++) {
+            const ScvUByte *a = (const ScvUByte *)scvGetRowRef(prev, iy);
+            const ScvUByte *b = (const ScvUByte *)scvGetRowRef(cur, iy);
+            for (int bx = 0; bx < map->cols; bx++) {
+                const int end = MIN((bx + 1) * bs * 3, n);
+                int maxDiff = blockDiff[bx];
+                for (int i = bx * bs * 3; i < end; i++) {
+                    const int d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+                    maxDiff = d > maxDiff ? d : maxDiff;
                 }
+                blockDiff[bx] = maxDiff;
             }
-            if ((M[nPointIdx] >= dTmp1) && (M[nPointIdx] >= dTmp2)) {
-                N[nPointIdx] = 128;
-            } else {
-                N[nPointIdx] = 0;
+        }
+        for (int bx = 0; bx < map->cols; bx++) {
+            if (blockDiff[bx] > threshold && !dirty[bx]) {
+                dirty[bx] = 1;
+                marked++;
             }
         }
     }
 
-    int nHist[1024];
-    int nEdgeNum;
-    int nMaxMag = 0;
-    int nHighCount;
+    free(blockDiff);
+    return marked;
+}
 
-    for (i = 0; i < 1024; i++) {
-        nHist[i] = 0;
+void scvGrayingDirty(const ScvImage *src, ScvImage *dst, SCV_GRAYING_TYPE type, const ScvDirtyMap *map) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        return;
     }
-    for (i = 0; i < nHeight; i++) {
-        for (j = 0; j < nWidth; j++) {
-            if (N[i * nWidth + j] == 128) nHist[M[i * nWidth + j]]++;
-        }
+    int count;
+    ScvRect *rects = collectDirtyRects(map, 0, &count);
+    for (int i = 0; i < count; i++) {
+        grayingRect(src, dst, type, rects[i]);
     }
+    free(rects);
+}
 
-    nEdgeNum = nHist[0];
-    nMaxMag = 0;
-    for (i = 1; i < 1024; i++) {
-        if (nHist[i] != 0) {
-            nMaxMag = i;
-        }
-        nEdgeNum += nHist[i];
+void scvSmoothDirty(const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type, const ScvDirtyMap *map) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        return;
+    }
+    int count;
+    ScvRect *rects = collectDirtyRects(map, 0, &count);
+    for (int i = 0; i < count; i++) {
+        smoothRect(src, dst, type, expandRect(rects[i], 1, src->width, src->height));
     }
+    free(rects);
+}
 
-    float dRatHigh = 0.79;
-    float dThrHigh;
-    float dThrLow;
-    float dRatLow = 0.5;
-    nHighCount = (int)(dRatHigh * nEdgeNum + 0.5f);
-    j = 1;
-    nEdgeNum = nHist[1];
-    while ((j < (nMaxMag - 1)) && (nEdgeNum < nHighCount)) {
-        j++;
-        nEdgeNum += nHist[j];
+void scvThresholdDirty(const ScvImage *prev,
+                       const ScvImage *src,
+                       ScvImage *dst,
+                       ScvHistogram *hist,
+                       const ScvDirtyMap *map) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth || (NULL != prev && SCV_DEPTH_8U != prev->depth)) {
+        return;
     }
-    dThrHigh = j;
-    dThrLow = (int)((dThrHigh)*dRatLow + 0.5f);
 
-    ScvSize sz;
-    sz.width = nWidth;
-    sz.height = nHeight;
-    for (i = 0; i < nHeight; i++) {
-        for (j = 0; j < nWidth; j++) {
-            if ((N[i * nWidth + j] == 128) && (M[i * nWidth + j] >= dThrHigh)) {
-                N[i * nWidth + j] = 255;
-                traceEdge(i, j, (int)(dThrLow + 0.5f), N, M, sz);
-            }
-        }
+    const ScvRect whole = scvRect(0, 0, src->width, src->height);
+    const int total = src->width * src->height;
+    if (NULL == prev) {
+        scvCalcHist(src, hist);
+        thresholdRect(src, dst, hist->grayingType, thresholdOtsu(hist, total), whole);
+        return;
     }
 
-    // Canny algorithm end
+    const float oldThresh = thresholdOtsu(hist, total);
+    int count;
+    ScvRect *rects = collectDirtyRects(map, 0, &count);
+    for (int i = 0; i < count; i++) {
+        histRect(prev, hist, rects[i], -1);
+        histRect(src, hist, rects[i], 1);
+    }
 
-    for (iy = 0; iy < nHeight; iy++) {
-        for (ix = 0; ix < nWidth; ix++) {
-            if (N[iy * nWidth + ix] != 255) {
-                scvSetPixel(path, ix, iy, scvPixelAll(0));
-            } else {
-                scvSetPixel(path, ix, iy, scvPixelAll(255));
-            }
+    const float thresh = thresholdOtsu(hist, total);
+    if (thresh != oldThresh) {
+        thresholdRect(src, dst, hist->grayingType, thresh, whole);
+    } else {
+        for (int i = 0; i < count; i++) {
+            thresholdRect(src, dst, hist->grayingType, thresh, rects[i]);
         }
     }
-
-    scvReleaseImage(filtered);
-    free(P);
-    free(Q);
-    free(M);
-    free(theta);
-    free(N);
+    free(rects);
 }
 
-void scvAddWeighed(const ScvImage *src1, float alpha, const ScvImage *src2, float beta, ScvImage *dst) {
-    float rate = 1.0f / (alpha + beta);
-    alpha *= rate;
-    beta *= rate;
+void scvCannyDirty(const ScvImage *image, ScvImage *path, ScvCannyState *state, const ScvDirtyMap *map) {
+    if (SCV_DEPTH_8U != image->depth || SCV_DEPTH_8U != path->depth) {
+        return;
+    }
+    // A changed pixel reaches 3 pixels away through smoothing, gradient and suppression, i.e. one block
+    int count;
+    ScvRect *rects = collectDirtyRects(map, 1, &count);
 
-    for (int iy = 0; iy < dst->height; iy++) {
-        for (int ix = 0; ix < dst->width; ix++) {
-            if (ix < src1->width && iy < src1->height && ix < src2->width && iy < src2->height) {
-                // In range of both src1 and src2
-                ScvPixel pxl1 = scvGetPixel(src1, ix, iy);
-                ScvPixel pxl2 = scvGetPixel(src2, ix, iy);
-                scvSetPixel(dst,
-                            ix,
-                            iy,
-                            scvPixel((int)(alpha * pxl1.b + beta * pxl2.b),
-                                     (int)(alpha * pxl1.g + beta * pxl2.g),
-                                     (int)(alpha * pxl1.r + beta * pxl2.r)));
-            } else if (ix < src1->width && iy < src1->height) {
-                // In range of src1
-                scvSetPixel(dst, ix, iy, scvGetPixel(src1, ix, iy));
-            } else if (ix < src2->width && iy < src2->height) {
-                // In range of src2
-                scvSetPixel(dst, ix, iy, scvGetPixel(src2, ix, iy));
-            }
-        }
+    // Old candidates have to leave the histogram before any magnitude is overwritten
+    for (int i = 0; i < count; i++) {
+        cannyForgetRect(state, rects[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        cannyRect(image, state, rects[i]);
     }
+    free(rects);
+
+    cannyHysteresis(state, path);
 }
@@ -37,10 +37,22 @@ void scvCopyMat(const ScvMat *src, ScvMat *dst);
 
 void scvReleaseMat(ScvMat *mat);
 
+/**
+ * The images are filled with 0. Returns NULL if the size is negative, too large for int row offsets,
+ * or cannot be allocated.
+ */
 ScvImage *scvCreateImage(ScvSize size);
 
+ScvImage *scvCreateImageWithDepth(ScvSize size, SCV_DEPTH depth);
+
+/**
+ * Returns NULL if the copy cannot be allocated.
+ */
 ScvImage *scvCloneImage(const ScvImage *image);
 
+/**
+ * Does nothing if the depths differ, use scvConvertImage then.
+ */
 void scvCopyImage(const ScvImage *src, ScvImage *dst);
 
 void scvReleaseImage(ScvImage *image);
@@ -53,10 +65,47 @@ void scvCopyHist(const ScvHistogram *src, ScvHistogram *dst);
 
 void scvReleaseHist(ScvHistogram *histogram);
 
+/**
+ * Block size should be at least 4, smaller values are raised to 4.
+ */
+ScvDirtyMap *scvCreateDirtyMap(ScvSize size, int blockSize);
+
+void scvReleaseDirtyMap(ScvDirtyMap *map);
+
+ScvCannyState *scvCreateCannyState(ScvSize size);
+
+void scvReleaseCannyState(ScvCannyState *state);
+
+/**
+ * A map for destination images of the given size, fill it with scvBuildMap or scvBuildMapWithFunc.
+ */
+ScvMap *scvCreateMap(ScvSize size);
+
+void scvReleaseMap(ScvMap *map);
+
 #pragma mark - Getter and Setter
 
+/**
+ * Rows of images created afterwards start at a multiple of alignment bytes (64 by default),
+ * which must be a power of two and at least 4, other values are ignored.
+ */
+void scvSetImageAlignment(int alignment);
+
+int scvGetImageAlignment(void);
+
+/**
+ * Size of one channel value in byte.
+ */
+int scvGetDepthSize(SCV_DEPTH depth);
+
 ScvPixel *scvGetPixelRef(const ScvImage *image, int x, int y);
 
+/**
+ * Get the first pixel of the logical row y, taking image.origin into account.
+ * Returns NULL if y is out of range.
+ */
+ScvPixel *scvGetRowRef(const ScvImage *image, int y);
+
 ScvPixel scvGetPixel(const ScvImage *image, int x, int y);
 
 void scvSetPixel(ScvImage *image, int x, int y, ScvPixel pixel);
@@ -67,12 +116,70 @@ ScvPoint scvGetCenter(const ScvImage *image);
 
 #pragma mark - Calculator
 
+/**
+ * For depths other than SCV_DEPTH_8U, the 256 bins evenly cover the range of the depth.
+ */
 void scvCalcHist(const ScvImage *image, ScvHistogram *hist);
 
 #pragma mark - Geometrical Transformation
 
+/**
+ * src and dst must have the same depth, fillPxl is scaled to the range of the depth.
+ * src may be dst, then only the source rows that are still to be read are buffered.
+ */
 void scvWarpAffine(const ScvImage *src, ScvImage *dst, const ScvMat *mat, ScvPixel fillPxl);
 
+/**
+ * Projective warp with a 3x3 matrix mapping source points to destination points,
+ * sampled with nearest neighbor or bilinear interpolation, pixels outside of src are fillPxl.
+ * src and dst must have the same depth, src may be dst (the source is copied first then).
+ */
+void scvWarpPerspective(const ScvImage *src, ScvImage *dst, const ScvMat *mat, SCV_INTERPOLATION interpolation,
+                        ScvPixel fillPxl);
+
+/**
+ * The 3x3 perspective matrix mapping the 4 points of srcQuad to the 4 points of dstQuad,
+ * e.g. the corners of a photographed page to the corners of the rectified page.
+ * mat is left unchanged if 3 of the points are collinear.
+ */
+void scvPerspectiveMatrix(const ScvPoint *srcQuad, const ScvPoint *dstQuad, ScvMat *mat);
+
+/**
+ * Fills map with the source coordinates of a 2x3 affine or 3x3 perspective matrix,
+ * mapping source points to destination points like scvWarpAffine and scvWarpPerspective.
+ */
+void scvBuildMap(ScvMap *map, const ScvMat *mat);
+
+/**
+ * Fills map with the source coordinates func gives for every destination pixel center.
+ */
+void scvBuildMapWithFunc(ScvMap *map, ScvMapFunc func, void *userData);
+
+/**
+ * Samples dst from src where map says, pixels outside of src are fillPxl.
+ * The size of dst must be the size of map, src and dst must have the same depth, src may be dst.
+ */
+void scvRemap(const ScvImage *src, ScvImage *dst, const ScvMap *map, SCV_INTERPOLATION interpolation,
+              ScvPixel fillPxl);
+
+/**
+ * Exact flips, transposes and rotations by multiples of 90 degrees, pixels are moved and never resampled.
+ * The transposes work on cache-sized tiles. src and dst must have the same depth,
+ * src may be dst for flips and 180 degrees rotations, and for the others if the image is square.
+ */
+void scvFlip(const ScvImage *src, ScvImage *dst, SCV_FLIP_TYPE type);
+
+/**
+ * dst must be src->height wide and src->width high.
+ */
+void scvTranspose(const ScvImage *src, ScvImage *dst);
+
+/**
+ * Rotates counterclockwise by times * 90 degrees like scvRotationMatrix with a positive angle,
+ * negative times rotate clockwise. dst must be the size of the rotated image.
+ */
+void scvRotate90(const ScvImage *src, ScvImage *dst, int times);
+
 void scvRotationMatrix(ScvPoint center, float angle, ScvMat *mat);
 
 void scvScaleMatrix(ScvPoint center, float scaleX, float scaleY, ScvMat *mat);
@@ -97,13 +204,86 @@ void scvSplit(const ScvImage *src, ScvImage *b, ScvImage *g, ScvImage *r);
 
 void scvInverse(const ScvImage *src, ScvImage *dst);
 
+/**
+ * The result covers the range of the depth of dst.
+ */
 void scvEqualizeHist(const ScvImage *src, const ScvHistogram *hist, ScvImage *dst);
 
+/**
+ * src may be dst, source rows are buffered 3 at a time.
+ * Values are rescaled to the range of dst if the depths differ.
+ */
 void scvSmooth(const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type);
 
 // The image passed in must be gray-scaled image.
 void scvCanny(const ScvImage *image, ScvImage *path);
 
+/**
+ * Values are truncated if all images are SCV_DEPTH_8U,
+ * otherwise they are rescaled to the range of dst, blended in float and rounded once into the depth of dst.
+ */
 void scvAddWeighed(const ScvImage *src1, float alpha, const ScvImage *src2, float beta, ScvImage *dst);
 
+/**
+ * dst = src * scale + shift, rounded and saturated to the depth of dst.
+ * E.g. scale is 1.0f / 255 to convert SCV_DEPTH_8U to SCV_DEPTH_32F.
+ */
+void scvConvertImage(const ScvImage *src, ScvImage *dst, float scale, float shift);
+
+#pragma mark - Batch
+
+/**
+ * scvCanny, scvThreshold and scvWarpAffine over count images at once, srcs[i] to dsts[i], for many small images:
+ * the images are spread over threads, and the setup is done once per call (scvWarpAffineBatch)
+ * or once per thread (the scratch of scvCannyBatch, kept while consecutive images have the same size,
+ * and the histogram of scvThresholdBatch). The results are the same as calling the operations one by one.
+ * An image of srcs must not be in dsts at another index.
+ */
+void scvCannyBatch(ScvImage **images, ScvImage **paths, int count);
+
+void scvThresholdBatch(ScvImage **srcs, ScvImage **dsts, int count, SCV_GRAYING_TYPE grayingType);
+
+void scvWarpAffineBatch(ScvImage **srcs, ScvImage **dsts, int count, const ScvMat *mat, ScvPixel fillPxl);
+
+#pragma mark - Incremental
+
+/**
+ * Incremental versions of the operations above for frame sequences.
+ * Only the pixels affected by the dirty blocks of the map are recalculated into dst,
+ * which must hold the result for the previous frame. src and dst cannot be the same image.
+ */
+
+void scvClearDirtyMap(ScvDirtyMap *map);
+
+void scvMarkDirty(ScvDirtyMap *map, ScvRect rect);
+
+void scvMarkAllDirty(ScvDirtyMap *map);
+
+/**
+ * Marks the blocks in which any channel of any pixel differs by more than threshold.
+ * Returns the number of blocks marked.
+ */
+int scvDiffFrames(const ScvImage *prev, const ScvImage *cur, int threshold, ScvDirtyMap *map);
+
+void scvGrayingDirty(const ScvImage *src, ScvImage *dst, SCV_GRAYING_TYPE type, const ScvDirtyMap *map);
+
+void scvSmoothDirty(const ScvImage *src, ScvImage *dst, SCV_SMOOTH_TYPE type, const ScvDirtyMap *map);
+
+/**
+ * hist must be the histogram of prev, it's updated to src. The Otsu threshold is global,
+ * so the whole image is thresholded again if it changes.
+ * If prev is NULL, the histogram is calculated from scratch and the whole image is thresholded.
+ */
+void scvThresholdDirty(const ScvImage *prev,
+                       const ScvImage *src,
+                       ScvImage *dst,
+                       ScvHistogram *hist,
+                       const ScvDirtyMap *map);
+
+/**
+ * The state must have seen the whole image once, i.e. the first frame needs scvMarkAllDirty.
+ * Edges are traced over the whole image since they connect across blocks.
+ */
+void scvCannyDirty(const ScvImage *image, ScvImage *path, ScvCannyState *state, const ScvDirtyMap *map);
+
 #endif // SIMPLECV_CORE_H
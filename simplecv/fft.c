@@ -0,0 +1,494 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <math.h>
+#include <memory.h>
+#include <stdlib.h>
+
+#include "core.h"
+#include "fft.h"
+
+#pragma mark - Inner
+
+#define MAX_FACTORS 32
+
+typedef struct _FFTComplex {
+    float re;
+    float im;
+} FFTComplex;
+
+/**
+ * FFTComplex FFT plan of length n, in the style of KISS FFT:
+ * factors holds (radix, remaining length) pairs, twiddles[i] = exp(-2 pi i / n).
+ * The inverse is done with conjugation, ifft(x) = conj(fft(conj(x))).
+ */
+typedef struct _ComplexPlan {
+    int n;
+    int factors[MAX_FACTORS * 2];
+    int maxRadix;
+    FFTComplex *twiddles;
+} ComplexPlan;
+
+ComplexPlan *createComplexPlan(int n) {
+    ComplexPlan *plan = (ComplexPlan *)malloc(sizeof(ComplexPlan));
+    plan->n = n;
+    plan->twiddles = (FFTComplex *)malloc(sizeof(FFTComplex) * n);
+    for (int i = 0; i < n; i++) {
+        const double angle = -2.0 * 3.14159265358979323846 * i / n;
+        plan->twiddles[i].re = (float)cos(angle);
+        plan->twiddles[i].im = (float)sin(angle);
+    }
+
+    // Radix 4 first, then 2, then odd factors
+    int remaining = n;
+    int p = 4;
+    int count = 0;
+    plan->maxRadix = 1;
+    while (remaining > 1) {
+        while (remaining % p) {
+            p = 4 == p ? 2 : 2 == p ? 3 : p + 2;
+            if (p * p > remaining) {
+                p = remaining;
+            }
+        }
+        remaining /= p;
+        plan->factors[count * 2] = p;
+        plan->factors[count * 2 + 1] = remaining;
+        plan->maxRadix = p > plan->maxRadix ? p : plan->maxRadix;
+        count++;
+    }
+    return plan;
+}
+
+void releaseComplexPlan(ComplexPlan *plan) {
+    free(plan->twiddles);
+    free(plan);
+}
+
+SCV_INLINE FFTComplex fftComplexMul(FFTComplex a, FFTComplex b) {
+    FFTComplex c;
+    c.re = a.re * b.re - a.im * b.im;
+    c.im = a.re * b.im + a.im * b.re;
+    return c;
+}
+
+void butterfly2(FFTComplex *out, const FFTComplex *tw, int fstride, int m) {
+    for (int k = 0; k < m; k++) {
+        const FFTComplex t = fftComplexMul(out[k + m], tw[k * fstride]);
+        out[k + m].re = out[k].re - t.re;
+        out[k + m].im = out[k].im - t.im;
+        out[k].re += t.re;
+        out[k].im += t.im;
+    }
+}
+
+void butterfly3(FFTComplex *out, const FFTComplex *tw, int fstride, int m) {
+    const float epi3 = tw[fstride * m].im;
+    for (int k = 0; k < m; k++) {
+        const FFTComplex s1 = fftComplexMul(out[k + m], tw[k * fstride]);
+        const FFTComplex s2 = fftComplexMul(out[k + 2 * m], tw[2 * k * fstride]);
+        const FFTComplex s3 = {s1.re + s2.re, s1.im + s2.im};
+        const FFTComplex s0 = {(s1.re - s2.re) * epi3, (s1.im - s2.im) * epi3};
+        const FFTComplex half = {out[k].re - s3.re * 0.5f, out[k].im - s3.im * 0.5f};
+        out[k].re += s3.re;
+        out[k].im += s3.im;
+        out[k + 2 * m].re = half.re + s0.im;
+        out[k + 2 * m].im = half.im - s0.re;
+        out[k + m].re = half.re - s0.im;
+        out[k + m].im = half.im + s0.re;
+    }
+}
+
+void butterfly4(FFTComplex *out, const FFTComplex *tw, int fstride, int m) {
+    for (int k = 0; k < m; k++) {
+        const FFTComplex s0 = fftComplexMul(out[k + m], tw[k * fstride]);
+        const FFTComplex s1 = fftComplexMul(out[k + 2 * m], tw[2 * k * fstride]);
+        const FFTComplex s2 = fftComplexMul(out[k + 3 * m], tw[3 * k * fstride]);
+        const FFTComplex s5 = {out[k].re - s1.re, out[k].im - s1.im};
+        const FFTComplex s3 = {s0.re + s2.re, s0.im + s2.im};
+        const FFTComplex s4 = {s0.re - s2.re, s0.im - s2.im};
+        out[k].re += s1.re;
+        out[k].im += s1.im;
+        out[k + 2 * m].re = out[k].re - s3.re;
+        out[k + 2 * m].im = out[k].im - s3.im;
+        out[k].re += s3.re;
+        out[k].im += s3.im;
+        out[k + m].re = s5.re + s4.im;
+        out[k + m].im = s5.im - s4.re;
+        out[k + 3 * m].re = s5.re - s4.im;
+        out[k + 3 * m].im = s5.im + s4.re;
+    }
+}
+
+// Any radix p, O(p^2) per butterfly, scratch holds p values
+void butterflyGeneric(FFTComplex *out, const FFTComplex *tw, int fstride, int m, int p, int n, FFTComplex *scratch) {
+    for (int u = 0; u < m; u++) {
+        for (int q = 0; q < p; q++) {
+            scratch[q] = out[u + q * m];
+        }
+        for (int q1 = 0; q1 < p; q1++) {
+            const int k = u + q1 * m;
+            FFTComplex sum = scratch[0];
+            int index = 0;
+            for (int q = 1; q < p; q++) {
+                index += fstride * k;
+                if (index >= n) {
+                    index %= n;
+                }
+                const FFTComplex t = fftComplexMul(scratch[q], tw[index]);
+                sum.re += t.re;
+                sum.im += t.im;
+            }
+            out[k] = sum;
+        }
+    }
+}
+
+/**
+ * Decimation in time: the p sub-sequences of stride fstride * p are transformed recursively
+ * into consecutive blocks of m values, then combined with radix-p butterflies.
+ */
+void complexWork(const ComplexPlan *plan, FFTComplex *out, const FFTComplex *in, int fstride, const int *factors,
+                 FFTComplex *scratch) {
+    const int p = factors[0];
+    const int m = factors[1];
+    const FFTComplex *outEnd = out + p * m;
+    FFTComplex *outBegin = out;
+
+    if (1 == m) {
+        for (; out != outEnd; out++, in += fstride) {
+            *out = *in;
+        }
+    } else {
+        for (; out != outEnd; out += m, in += fstride) {
+            complexWork(plan, out, in, fstride * p, factors + 2, scratch);
+        }
+    }
+
+    switch (p) {
+    case 2:
+        butterfly2(outBegin, plan->twiddles, fstride, m);
+        break;
+    case 3:
+        butterfly3(outBegin, plan->twiddles, fstride, m);
+        break;
+    case 4:
+        butterfly4(outBegin, plan->twiddles, fstride, m);
+        break;
+    default:
+        butterflyGeneric(outBegin, plan->twiddles, fstride, m, p, plan->n, scratch);
+        break;
+    }
+}
+
+/**
+ * out must not be in, scratch holds maxRadix values.
+ * For the inverse in is conjugated in place, except for a single value whose transform is itself.
+ */
+void complexFFT(const ComplexPlan *plan, FFTComplex *in, FFTComplex *out, int inverse, FFTComplex *scratch) {
+    const int n = plan->n;
+    if (n <= 1) {
+        memcpy(out, in, sizeof(FFTComplex) * n);
+        return;
+    }
+    if (inverse) {
+        for (int i = 0; i < n; i++) {
+            in[i].im = -in[i].im;
+        }
+    }
+    complexWork(plan, out, in, 1, plan->factors, scratch);
+    if (inverse) {
+        for (int i = 0; i < n; i++) {
+            out[i].im = -out[i].im;
+        }
+    }
+}
+
+/**
+ * Transforms the columns of the spectrum in place.
+ */
+void transformColumns(const ScvFFTPlan *plan, FFTComplex *spectrum, int inverse) {
+    const ComplexPlan *colPlan = (const ComplexPlan *)plan->colPlan;
+    const int rows = plan->rows;
+    const int specCols = plan->specCols;
+
+#pragma omp parallel
+    {
+        FFTComplex *in = (FFTComplex *)malloc(sizeof(FFTComplex) * (rows * 2 + colPlan->maxRadix));
+        FFTComplex *out = in + rows;
+        FFTComplex *scratch = out + rows;
+        int k;
+#pragma omp for schedule(static)
+        for (k = 0; k < specCols; k++) {
+            for (int i = 0; i < rows; i++) {
+                in[i] = spectrum[i * specCols + k];
+            }
+            complexFFT(colPlan, in, out, inverse, scratch);
+            for (int i = 0; i < rows; i++) {
+                spectrum[i * specCols + k] = out[i];
+            }
+        }
+        free(in);
+    }
+}
+
+/**
+ * Two real rows a and b are transformed at once as a + ib, their spectra are then separated:
+ * A[k] = (Z[k] + conj(Z[n - k])) / 2, B[k] = (Z[k] - conj(Z[n - k])) / 2i.
+ * b is NULL for the last row of an odd count.
+ */
+void forwardRowPair(const ScvFFTPlan *plan, const float *a, const float *b, FFTComplex *specA, FFTComplex *specB,
+                    FFTComplex *buffer) {
+    const ComplexPlan *rowPlan = (const ComplexPlan *)plan->rowPlan;
+    const int n = plan->cols;
+    FFTComplex *in = buffer;
+    FFTComplex *z = in + n;
+    FFTComplex *scratch = z + n;
+
+    for (int j = 0; j < n; j++) {
+        in[j].re = a[j];
+        in[j].im = b ? b[j] : 0.0f;
+    }
+    complexFFT(rowPlan, in, z, 0, scratch);
+
+    for (int k = 0; k < plan->specCols; k++) {
+        const FFTComplex zk = z[k];
+        const FFTComplex zn = {z[(n - k) % n].re, -z[(n - k) % n].im};
+        specA[k].re = (zk.re + zn.re) * 0.5f;
+        specA[k].im = (zk.im + zn.im) * 0.5f;
+        if (specB) {
+            specB[k].re = (zk.im - zn.im) * 0.5f;
+            specB[k].im = -(zk.re - zn.re) * 0.5f;
+        }
+    }
+}
+
+/**
+ * Inverse of forwardRowPair, the full spectra are rebuilt from the halves by symmetry,
+ * Z[k] = A[k] + iB[k], and the results are scaled by scale.
+ */
+void inverseRowPair(const ScvFFTPlan *plan, const FFTComplex *specA, const FFTComplex *specB, float *a, float *b,
+                    float scale, FFTComplex *buffer) {
+    const ComplexPlan *rowPlan = (const ComplexPlan *)plan->rowPlan;
+    const int n = plan->cols;
+    FFTComplex *z = buffer;
+    FFTComplex *out = z + n;
+    FFTComplex *scratch = out + n;
+
+    for (int k = 0; k < n; k++) {
+        FFTComplex ak, bk = {0.0f, 0.0f};
+        if (k < plan->specCols) {
+            ak = specA[k];
+            if (specB) {
+                bk = specB[k];
+            }
+        } else {
+            ak.re = specA[n - k].re;
+            ak.im = -specA[n - k].im;
+            bk.re = specB ? specB[n - k].re : 0.0f;
+            bk.im = specB ? -specB[n - k].im : 0.0f;
+        }
+        z[k].re = ak.re - bk.im;
+        z[k].im = ak.im + bk.re;
+    }
+    complexFFT(rowPlan, z, out, 1, scratch);
+
+    for (int j = 0; j < n; j++) {
+        a[j] = out[j].re * scale;
+        if (b) {
+            b[j] = out[j].im * scale;
+        }
+    }
+}
+
+void forwardRows(const ScvFFTPlan *plan, const float *src, FFTComplex *spectrum) {
+    const int rows = plan->rows;
+    const int cols = plan->cols;
+    const int specCols = plan->specCols;
+    const int maxRadix = ((const ComplexPlan *)plan->rowPlan)->maxRadix;
+
+#pragma omp parallel
+    {
+        FFTComplex *buffer = (FFTComplex *)malloc(sizeof(FFTComplex) * (cols * 2 + maxRadix));
+        int i;
+#pragma omp for schedule(static)
+        for (i = 0; i < rows; i += 2) {
+            const int paired = i + 1 < rows;
+            const float *b = paired ? src + (i + 1) * cols : NULL;
+            FFTComplex *specB = paired ? spectrum + (i + 1) * specCols : NULL;
+            forwardRowPair(plan, src + i * cols, b, spectrum + i * specCols, specB, buffer);
+        }
+        free(buffer);
+    }
+}
+
+void inverseRows(const ScvFFTPlan *plan, const FFTComplex *spectrum, float *dst) {
+    const int rows = plan->rows;
+    const int cols = plan->cols;
+    const int specCols = plan->specCols;
+    const int maxRadix = ((const ComplexPlan *)plan->rowPlan)->maxRadix;
+    const float scale = 1.0f / ((float)rows * cols);
+
+#pragma omp parallel
+    {
+        FFTComplex *buffer = (FFTComplex *)malloc(sizeof(FFTComplex) * (cols * 2 + maxRadix));
+        int i;
+#pragma omp for schedule(static)
+        for (i = 0; i < rows; i += 2) {
+            const int paired = i + 1 < rows;
+            const FFTComplex *specB = paired ? spectrum + (i + 1) * specCols : NULL;
+            float *b = paired ? dst + (i + 1) * cols : NULL;
+            inverseRowPair(plan, spectrum + i * specCols, specB, dst + i * cols, b, scale, buffer);
+        }
+        free(buffer);
+    }
+}
+
+ScvBool fitsPlan(const ScvFFTPlan *plan, const ScvMat *spectrum) {
+    return spectrum->rows == plan->rows && spectrum->cols == plan->specCols * 2;
+}
+
+/**
+ * Images are transformed through a 32F copy, so that every depth is read and written the same way.
+ */
+ScvImage *floatImageOf(const ScvImage *image) {
+    ScvImage *result = scvCreateImageWithDepth(scvGetSize(image), SCV_DEPTH_32F);
+    scvConvertImage(image, result, 1.0f, 0.0f);
+    return result;
+}
+
+#pragma mark - Export
+
+#pragma mark-- Make
+
+ScvFFTPlan *scvCreateFFTPlan(int rows, int cols) {
+    if (rows <= 0 || cols <= 0) {
+        return NULL;
+    }
+
+    ScvFFTPlan *plan = (ScvFFTPlan *)malloc(sizeof(ScvFFTPlan));
+    plan->rows = rows;
+    plan->cols = cols;
+    plan->specCols = cols / 2 + 1;
+    plan->rowPlan = createComplexPlan(cols);
+    plan->colPlan = createComplexPlan(rows);
+    return plan;
+}
+
+void scvReleaseFFTPlan(ScvFFTPlan *plan) {
+    releaseComplexPlan((ComplexPlan *)plan->rowPlan);
+    releaseComplexPlan((ComplexPlan *)plan->colPlan);
+    free(plan);
+}
+
+int scvGetOptimalFFTSize(int n) {
+    for (int size = n > 1 ? n : 1;; size++) {
+        int m = size;
+        while (m % 2 == 0) {
+            m /= 2;
+        }
+        while (m % 3 == 0) {
+            m /= 3;
+        }
+        while (m % 5 == 0) {
+            m /= 5;
+        }
+        if (1 == m) {
+            return size;
+        }
+    }
+}
+
+#pragma mark-- Transform
+
+void scvFFT(const ScvFFTPlan *plan, const ScvMat *src, ScvMat *spectrum) {
+    if (src->rows != plan->rows || src->cols != plan->cols || !fitsPlan(plan, spectrum)) {
+        return;
+    }
+
+    forwardRows(plan, src->data, (FFTComplex *)spectrum->data);
+    transformColumns(plan, (FFTComplex *)spectrum->data, 0);
+}
+
+void scvInverseFFT(const ScvFFTPlan *plan, const ScvMat *spectrum, ScvMat *dst) {
+    if (dst->rows != plan->rows || dst->cols != plan->cols || !fitsPlan(plan, spectrum)) {
+        return;
+    }
+
+    // The column pass works on a copy, spectrum is left untouched
+    const size_t count = (size_t)plan->rows * plan->specCols;
+    FFTComplex *tmp = (FFTComplex *)malloc(sizeof(FFTComplex) * count);
+    memcpy(tmp, spectrum->data, sizeof(FFTComplex) * count);
+    transformColumns(plan, tmp, 1);
+    inverseRows(plan, tmp, dst->data);
+    free(tmp);
+}
+
+void scvFFTImage(const ScvFFTPlan *plan, const ScvImage *image, int channel, ScvMat *spectrum) {
+    if (image->height != plan->rows || image->width != plan->cols || channel < 0 || channel > 2) {
+        return;
+    }
+
+    ScvImage *floatImage = floatImageOf(image);
+    ScvMat *values = scvCreateMat(plan->rows, plan->cols);
+    for (int y = 0; y < plan->rows; y++) {
+        const float *row = (const float *)scvGetRowRef(floatImage, y);
+        for (int x = 0; x < plan->cols; x++) {
+            values->data[y * plan->cols + x] = row[x * 3 + channel];
+        }
+    }
+    scvFFT(plan, values, spectrum);
+    scvReleaseMat(values);
+    scvReleaseImage(floatImage);
+}
+
+void scvInverseFFTImage(const ScvFFTPlan *plan, const ScvMat *spectrum, ScvImage *image, int channel) {
+    if (image->height != plan->rows || image->width != plan->cols || channel < 0 || channel > 2) {
+        return;
+    }
+
+    ScvImage *floatImage = floatImageOf(image);
+    ScvMat *values = scvCreateMat(plan->rows, plan->cols);
+    scvInverseFFT(plan, spectrum, values);
+    for (int y = 0; y < plan->rows; y++) {
+        float *row = (float *)scvGetRowRef(floatImage, y);
+        for (int x = 0; x < plan->cols; x++) {
+            row[x * 3 + channel] = values->data[y * plan->cols + x];
+        }
+    }
+    scvConvertImage(floatImage, image, 1.0f, 0.0f);
+    scvReleaseMat(values);
+    scvReleaseImage(floatImage);
+}
+
+void scvMulSpectrums(const ScvMat *a, const ScvMat *b, ScvMat *dst, ScvBool conjB) {
+    if (a->rows != b->rows || a->cols != b->cols || a->rows != dst->rows || a->cols != dst->cols) {
+        return;
+    }
+
+    const int count = a->rows * a->cols / 2;
+    const float sign = conjB ? -1.0f : 1.0f;
+    for (int i = 0; i < count; i++) {
+        const float re1 = a->data[i * 2], im1 = a->data[i * 2 + 1];
+        const float re2 = b->data[i * 2], im2 = b->data[i * 2 + 1] * sign;
+        dst->data[i * 2] = re1 * re2 - im1 * im2;
+        dst->data[i * 2 + 1] = re1 * im2 + im1 * re2;
+    }
+}
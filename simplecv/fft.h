@@ -0,0 +1,71 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "types.h"
+
+#ifndef SIMPLECV_FFT_H
+#define SIMPLECV_FFT_H
+
+#pragma mark - Make
+
+/**
+ * Plans a real 2-D FFT of any size (mixed radix), the twiddles are computed once here
+ * so that one plan can transform a stream of frames of the same size.
+ * Sizes made of the factors 2, 3 and 5 are the fastest, see scvGetOptimalFFTSize.
+ */
+ScvFFTPlan *scvCreateFFTPlan(int rows, int cols);
+
+void scvReleaseFFTPlan(ScvFFTPlan *plan);
+
+/**
+ * The smallest size not less than n with no prime factors other than 2, 3 and 5.
+ */
+int scvGetOptimalFFTSize(int n);
+
+#pragma mark - Transform
+
+/**
+ * Forward transform of a rows * cols matrix into a rows * (2 * specCols) spectrum.
+ */
+void scvFFT(const ScvFFTPlan *plan, const ScvMat *src, ScvMat *spectrum);
+
+/**
+ * Inverse of scvFFT, scaled by 1 / (rows * cols) so that it restores the input.
+ */
+void scvInverseFFT(const ScvFFTPlan *plan, const ScvMat *spectrum, ScvMat *dst);
+
+/**
+ * Same as scvFFT on one channel (0 for blue, 1 for green, 2 for red) of an image of any depth.
+ * The image must have the size of the plan.
+ */
+void scvFFTImage(const ScvFFTPlan *plan, const ScvImage *image, int channel, ScvMat *spectrum);
+
+/**
+ * Same as scvInverseFFT into one channel of an image, rounded and saturated to its depth.
+ */
+void scvInverseFFTImage(const ScvFFTPlan *plan, const ScvMat *spectrum, ScvImage *image, int channel);
+
+/**
+ * Element-wise complex product of two spectra, b is conjugated if conjB is true (for correlation).
+ * dst may be a or b.
+ */
+void scvMulSpectrums(const ScvMat *a, const ScvMat *b, ScvMat *dst, ScvBool conjB);
+
+#endif // SIMPLECV_FFT_H
@@ -0,0 +1,768 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <math.h>
+#include <memory.h>
+#include <stdlib.h>
+
+#include "core.h"
+#include "fft.h"
+#include "filter.h"
+
+#pragma mark - Inner
+
+#define MIN(val1, val2) ((val1) > (val2) ? (val2) : (val1))
+#define MAX(val1, val2) ((val1) > (val2) ? (val1) : (val2))
+
+// Kernels up to this size are applied directly, larger ones with van Herk/Gil-Werman
+#define MORPH_DIRECT_MAX 5
+
+/**
+ * Erosion and dilation share one implementation which always takes the minimum,
+ * dilation flips every byte on the way in and out since max(a, b) == ~min(~a, ~b).
+ */
+
+void minRow(ScvUByte *dst, const ScvUByte *src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = MIN(dst[i], src[i]);
+    }
+}
+
+void minRows(ScvUByte *dst, const ScvUByte *a, const ScvUByte *b, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = MIN(a[i], b[i]);
+    }
+}
+
+void xorRow(ScvUByte *dst, const ScvUByte *src, int n, ScvUByte flip) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = src[i] ^ flip;
+    }
+}
+
+/**
+ * Horizontal pass of one row.
+ * pad holds the row with (k - 1) identity pixels around it, g and h are scratch rows of the same length.
+ */
+void erodeRowH(const ScvUByte *pad, ScvUByte *g, ScvUByte *h, ScvUByte *out, int width, int k) {
+    const int n = width * 3;
+    if (k <= MORPH_DIRECT_MAX) {
+        memcpy(out, pad, (size_t)n);
+        for (int d = 1; d < k; d++) {
+            minRow(out, pad + d * 3, n);
+        }
+        return;
+    }
+
+    // g: running minimum from the start of each k-pixel block, h: from the end
+    const int padWidth = width + k - 1;
+    for (int i = 0; i < padWidth; i++) {
+        const int j = i * 3;
+        if (i % k == 0) {
+            g[j] = pad[j];
+            g[j + 1] = pad[j + 1];
+            g[j + 2] = pad[j + 2];
+        } else {
+            g[j] = MIN(g[j - 3], pad[j]);
+            g[j + 1] = MIN(g[j - 2], pad[j + 1]);
+            g[j + 2] = MIN(g[j - 1], pad[j + 2]);
+        }
+    }
+    for (int i = padWidth - 1; i >= 0; i--) {
+        const int j = i * 3;
+        if (i % k == k - 1 || i == padWidth - 1) {
+            h[j] = pad[j];
+            h[j + 1] = pad[j + 1];
+            h[j + 2] = pad[j + 2];
+        } else {
+            h[j] = MIN(h[j + 3], pad[j]);
+            h[j + 1] = MIN(h[j + 4], pad[j + 1]);
+            h[j + 2] = MIN(h[j + 5], pad[j + 2]);
+        }
+    }
+
+    // The window [x, x + k) spans the tail of one block and the head of the next
+    minRows(out, h, g + (k - 1) * 3, n);
+}
+
+void erodeImage(const ScvImage *src, ScvImage *dst, ScvSize kernel, ScvUByte flip) {
+    if (SCV_DEPTH_8U != src->depth || SCV_DEPTH_8U != dst->depth) {
+        return;
+    }
+
+    const int w = src->width;
+    const int ht = src->height;
+    const int n = w * 3;
+    const int kx = MAX(kernel.width, 1);
+    const int ky = MAX(kernel.height, 1);
+    const int ax = kx / 2;
+    const int ay = ky / 2;
+
+    // Horizontal pass, into a plain buffer so that src and dst can be the same image
+    ScvUByte *tmp = (ScvUByte *)malloc((size_t)n * ht);
+    const int padBytes = (w + kx - 1) * 3;
+    ScvUByte *pad = (ScvUByte *)malloc((size_t)padBytes * 3);
+    ScvUByte *g = pad + padBytes;
+    ScvUByte *h = g + padBytes;
+    memset(pad, 255, (size_t)padBytes);
+    for (int y = 0; y < ht; y++) {
+        xorRow(pad + ax * 3, (const ScvUByte *)scvGetRowRef(src, y), n, flip);
+        erodeRowH(pad, g, h, tmp + y * n, w, kx);
+    }
+    free(pad);
+
+    // Vertical pass, whole rows at a time
+    const int padHeight = ht + ky - 1;
+    ScvUByte *identity = (ScvUByte *)malloc((size_t)n);
+    ScvUByte *out = (ScvUByte *)malloc((size_t)n);
+    memset(identity, 255, (size_t)n);
+#define PAD_ROW(p) ((p) < ay || (p) >= ay + ht ? identity : tmp + ((p)-ay) * n)
+
+    if (ky <= MORPH_DIRECT_MAX) {
+        for (int y = 0; y < ht; y++) {
+            memcpy(out, PAD_ROW(y), (size_t)n);
+            for (int d = 1; d < ky; d++) {
+                minRow(out, PAD_ROW(y + d), n);
+            }
+            xorRow((ScvUByte *)scvGetRowRef(dst, y), out, n, flip);
+        }
+    } else {
+        ScvUByte *hBlk = (ScvUByte *)malloc((size_t)n * ky);
+        ScvUByte *gBlk = (ScvUByte *)malloc((size_t)n * ky);
+        for (int b = 0; b * ky < ht; b++) {
+            const int first = b * ky;
+
+            // Suffix minimums of block b
+            const int last = MIN(first + ky, padHeight) - 1;
+            memcpy(hBlk + (last - first) * n, PAD_ROW(last), (size_t)n);
+            for (int p = last - 1; p >= first; p--) {
+                minRows(hBlk + (p - first) * n, hBlk + (p - first + 1) * n, PAD_ROW(p), n);
+            }
+
+            // Prefix minimums of block b + 1
+            const int next = first + ky;
+            const int nextLast = MIN(next + ky - 1, padHeight) - 1;
+            if (next < padHeight) {
+                memcpy(gBlk, PAD_ROW(next), (size_t)n);
+            }
+            for (int p = next + 1; p <= nextLast; p++) {
+                minRows(gBlk + (p - next) * n, gBlk + (p - next - 1) * n, PAD_ROW(p), n);
+            }
+
+            for (int y = first; y < first + ky && y < ht; y++) {
+                const int i = y - first;
+                if (0 == i) {
+                    xorRow((ScvUByte *)scvGetRowRef(dst, y), hBlk, n, flip);
+                } else {
+                    minRows(out, hBlk + i * n, gBlk + (i - 1) * n, n);
+                    xorRow((ScvUByte *)scvGetRowRef(dst, y), out, n, flip);
+                }
+            }
+        }
+        free(hBlk);
+        free(gBlk);
+    }
+#undef PAD_ROW
+
+    free(identity);
+    free(out);
+    free(tmp);
+}
+
+/**
+ * Separable derivative kernels, the x derivative is smooth(y) * diff(x),
+ * the y derivative is diff(y) * smooth(x).
+ */
+typedef struct _SobelKernel {
+    int radius;
+    short smooth[5];
+    short diff[5];
+} SobelKernel;
+
+SobelKernel sobelKernelOfType(SCV_SOBEL_TYPE type) {
+    SobelKernel sobel3 = {1, {1, 2, 1}, {-1, 0, 1}};
+    SobelKernel sobel5 = {2, {1, 4, 6, 4, 1}, {-1, -2, 0, 2, 1}};
+    SobelKernel scharr = {1, {3, 10, 3}, {-1, 0, 1}};
+    switch (type) {
+    case SCV_SOBEL_5:
+        return sobel5;
+    case SCV_SOBEL_SCHARR:
+        return scharr;
+    case SCV_SOBEL_3:
+    default:
+        return sobel3;
+    }
+}
+
+void loadGrayRow(const ScvImage *image, int y, int x0, int x1, short *dst) {
+    const ScvPixel *row = scvGetRowRef(image, y);
+    for (int x = x0; x < x1; x++) {
+        dst[x - x0] = row[x].r;
+    }
+}
+
+// Kernels up to this area are applied directly, larger non-separable ones through FFT
+#define FILTER_DIRECT_MAX_AREA 121
+
+/**
+ * Generic filtering works on float images with 3 interleaved channels,
+ * a padded row replicates the border pixels on both sides.
+ */
+
+void padRowF(const float *src, float *dst, int width, int left, int right) {
+    for (int x = -left; x < width + right; x++) {
+        const float *pxl = src + MIN(MAX(x, 0), width - 1) * 3;
+        dst[(x + left) * 3] = pxl[0];
+        dst[(x + left) * 3 + 1] = pxl[1];
+        dst[(x + left) * 3 + 2] = pxl[2];
+    }
+}
+
+/**
+ * Rank-1 test: kernel == col * row within a small tolerance.
+ * The factors are taken from the row and the column of the largest element.
+ */
+ScvBool separateKernel(const ScvMat *kernel, float *col, float *row) {
+    const int kh = kernel->rows;
+    const int kw = kernel->cols;
+    const float *k = kernel->data;
+
+    int pivot = 0;
+    for (int i = 1; i < kh * kw; i++) {
+        if (fabsf(k[i]) > fabsf(k[pivot])) {
+            pivot = i;
+        }
+    }
+    const float maxAbs = fabsf(k[pivot]);
+    if (0.0f == maxAbs) {
+        return SCV_FALSE;
+    }
+
+    const int pi = pivot / kw;
+    const int pj = pivot % kw;
+    for (int i = 0; i < kh; i++) {
+        col[i] = k[i * kw + pj];
+    }
+    for (int j = 0; j < kw; j++) {
+        row[j] = k[pi * kw + j] / k[pivot];
+    }
+    for (int i = 0; i < kh; i++) {
+        for (int j = 0; j < kw; j++) {
+            if (fabsf(k[i * kw + j] - col[i] * row[j]) > 1e-5f * maxAbs) {
+                return SCV_FALSE;
+            }
+        }
+    }
+    return SCV_TRUE;
+}
+
+/**
+ * Horizontal pass with row, then vertical pass with col.
+ */
+void filterSeparable(const ScvImage *src, ScvImage *dst, const float *col, int kh, const float *row, int kw) {
+    const int w = src->width;
+    const int h = src->height;
+    const int n = w * 3;
+    const int ax = kw / 2;
+    const int ay = kh / 2;
+
+    ScvImage *tmp = scvCreateImageWithDepth(scvGetSize(src), SCV_DEPTH_32F);
+    float *pad = (float *)malloc(sizeof(float) * (w + kw) * 3);
+    for (int y = 0; y < h; y++) {
+        padRowF((const float *)scvGetRowRef(src, y), pad, w, ax, kw - 1 - ax);
+        float *out = (float *)scvGetRowRef(tmp, y);
+        memset(out, 0, sizeof(float) * n);
+        for (int j = 0; j < kw; j++) {
+            const float c = row[j];
+            const float *in = pad + j * 3;
+            for (int i = 0; i < n; i++) {
+                out[i] += c * in[i];
+            }
+        }
+    }
+
+    for (int y = 0; y < h; y++) {
+        float *out = (float *)scvGetRowRef(dst, y);
+        memset(out, 0, sizeof(float) * n);
+        for (int j = 0; j < kh; j++) {
+            const float c = col[j];
+            const float *in = (const float *)scvGetRowRef(tmp, MIN(MAX(y + j - ay, 0), h - 1));
+            for (int i = 0; i < n; i++) {
+                out[i] += c * in[i];
+            }
+        }
+    }
+
+    free(pad);
+    scvReleaseImage(tmp);
+}
+
+/**
+ * Every source row is padded once into a ring of kernel height rows,
+ * ring slot r % kh holds the padded source row r (clamped into the image).
+ */
+void filterDirect(const ScvImage *src, ScvImage *dst, const ScvMat *kernel) {
+    const int w = src->width;
+    const int h = src->height;
+    const int n = w * 3;
+    const int kh = kernel->rows;
+    const int kw = kernel->cols;
+    const int ax = kw / 2;
+    const int ay = kh / 2;
+    const int padN = (w + kw - 1) * 3;
+
+    float *ring = (float *)malloc(sizeof(float) * padN * kh);
+    for (int r = -ay; r < kh - 1 - ay; r++) {
+        const float *row = (const float *)scvGetRowRef(src, MIN(MAX(r, 0), h - 1));
+        padRowF(row, ring + (r + kh) % kh * padN, w, ax, kw - 1 - ax);
+    }
+
+    for (int y = 0; y < h; y++) {
+        const int r = y + kh - 1 - ay;
+        padRowF((const float *)scvGetRowRef(src, MIN(MAX(r, 0), h - 1)), ring + r % kh * padN, w, ax, kw - 1 - ax);
+
+        float *out = (float *)scvGetRowRef(dst, y);
+        memset(out, 0, sizeof(float) * n);
+        for (int ky = 0; ky < kh; ky++) {
+            const float *pad = ring + (y + ky - ay + kh) % kh * padN;
+            for (int kx = 0; kx < kw; kx++) {
+                const float c = kernel->data[ky * kw + kx];
+                if (0.0f == c) {
+                    continue;
+                }
+                const float *in = pad + kx * 3;
+                for (int i = 0; i < n; i++) {
+                    out[i] += c * in[i];
+                }
+            }
+        }
+    }
+    free(ring);
+}
+
+/**
+ * Correlation is the circular convolution of the border-padded image with the flipped kernel,
+ * the padded size is rounded up to a fast FFT size and wrapping never reaches the kept part.
+ */
+void filterFFT(const ScvImage *src, ScvImage *dst, const ScvMat *kernel) {
+    const int w = src->width;
+    const int h = src->height;
+    const int kh = kernel->rows;
+    const int kw = kernel->cols;
+    const int ax = kw / 2;
+    const int ay = kh / 2;
+    const int rows = scvGetOptimalFFTSize(h + kh - 1);
+    const int cols = scvGetOptimalFFTSize(w + kw - 1);
+
+    ScvFFTPlan *plan = scvCreateFFTPlan(rows, cols);
+    ScvMat *values = scvCreateMat(rows, cols);
+    ScvMat *kernelSpectrum = scvCreateMat(rows, plan->specCols * 2);
+    ScvMat *spectrum = scvCreateMat(rows, plan->specCols * 2);
+    float *pad = (float *)malloc(sizeof(float) * (w + kw) * 3);
+
+    memset(values->data, 0, sizeof(float) * rows * cols);
+    for (int i = 0; i < kh; i++) {
+        for (int j = 0; j < kw; j++) {
+            values->data[i * cols + j] = kernel->data[(kh - 1 - i) * kw + (kw - 1 - j)];
+        }
+    }
+    scvFFT(plan, values, kernelSpectrum);
+
+    for (int c = 0; c < 3; c++) {
+        memset(values->data, 0, sizeof(float) * rows * cols);
+        for (int i = 0; i < h + kh - 1; i++) {
+            padRowF((const float *)scvGetRowRef(src, MIN(MAX(i - ay, 0), h - 1)), pad, w, ax, kw - 1 - ax);
+            for (int j = 0; j < w + kw - 1; j++) {
+                values->data[i * cols + j] = pad[j * 3 + c];
+            }
+        }
+
+        scvFFT(plan, values, spectrum);
+        scvMulSpectrums(spectrum, kernelSpectrum, spectrum, SCV_FALSE);
+        scvInverseFFT(plan, spectrum, values);
+
+        for (int y = 0; y < h; y++) {
+            float *out = (float *)scvGetRowRef(dst, y);
+            const float *in = values->data + (y + kh - 1) * cols + kw - 1;
+            for (int x = 0; x < w; x++) {
+                out[x * 3 + c] = in[x];
+            }
+        }
+    }
+
+    free(pad);
+    scvReleaseMat(values);
+    scvReleaseMat(kernelSpectrum);
+    scvReleaseMat(spectrum);
+    scvReleaseFFTPlan(plan);
+}
+
+// Cells around the grid, wide enough for the blur taps
+#define BILATERAL_PAD 2
+// Luminance cells are at most this many, smaller color sigmas are raised to fit
+#define BILATERAL_MAX_DEPTH 256
+// Cells in the whole grid are at most this many (256 MB of sums), smaller space sigmas are raised to fit
+#define BILATERAL_MAX_CELLS (1 << 24)
+
+typedef struct _BilateralGrid {
+    int width; // Cells along x, y and luminance
+    int height;
+    int depth;
+    float *cells; // Sums of b, g, r and the weight, luminance is the innermost axis
+} BilateralGrid;
+
+/**
+ * Blurs n cells spaced stride floats apart with [1 4 6 4 1] / 16, about a Gaussian of one cell.
+ * The pad cells are zero, so the ends need no special care.
+ */
+void blurGridLine(float *base, int n, size_t stride, float *tmp) {
+    for (int i = 0; i < n; i++) {
+        memcpy(tmp + i * 4, base + i * stride, sizeof(float) * 4);
+    }
+    for (int i = BILATERAL_PAD; i < n - BILATERAL_PAD; i++) {
+        float *cell = base + i * stride;
+        const float *t = tmp + i * 4;
+        for (int c = 0; c < 4; c++) {
+            cell[c] = (t[c - 8] + t[c + 8] + 4.0f * (t[c - 4] + t[c + 4]) + 6.0f * t[c]) * (1.0f / 16.0f);
+        }
+    }
+}
+
+void blurGrid(BilateralGrid *grid) {
+    const int gw = grid->width, gh = grid->height, gd = grid->depth;
+    const size_t cell = 4;
+
+#pragma omp parallel
+    {
+        float *tmp = (float *)malloc(sizeof(float) * 4 * MAX(MAX(gw, gh), gd));
+        int i;
+#pragma omp for schedule(static)
+        for (i = 0; i < gw * gh; i++) {
+            blurGridLine(grid->cells + i * gd * cell, gd, cell, tmp);
+        }
+#pragma omp for schedule(static)
+        for (i = 0; i < gh * gd; i++) {
+            const int y = i / gd, z = i % gd;
+            blurGridLine(grid->cells + ((size_t)y * gw * gd + z) * cell, gw, gd * cell, tmp);
+        }
+#pragma omp for schedule(static)
+        for (i = 0; i < gw * gd; i++) {
+            const int x = i / gd, z = i % gd;
+            blurGridLine(grid->cells + ((size_t)x * gd + z) * cell, gh, (size_t)gw * gd * cell, tmp);
+        }
+        free(tmp);
+    }
+}
+
+#pragma mark - Export
+
+#pragma mark-- Gradient
+
+void scvSobel(const ScvImage *image, short *dx, short *dy, short *magnitude, SCV_SOBEL_TYPE type) {
+    scvSobelRect(image, scvRect(0, 0, image->width, image->height), dx, dy, magnitude, type);
+}
+
+void scvSobelRect(const ScvImage *image, ScvRect rect, short *dx, short *dy, short *magnitude, SCV_SOBEL_TYPE type) {
+    if (SCV_DEPTH_8U != image->depth) {
+        return;
+    }
+
+    const SobelKernel kernel = sobelKernelOfType(type);
+    const int r = kernel.radius;
+    const int ksize = 2 * r + 1;
+    const int w = image->width;
+    const int h = image->height;
+
+    const int x0 = MAX(rect.x, 0);
+    const int x1 = MIN(rect.x + rect.width, w);
+    const int y0 = MAX(rect.y, 0);
+    const int y1 = MIN(rect.y + rect.height, h);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // Source columns needed by the rect, the rest of the padded range replicates the image border
+    const int cx0 = MAX(x0 - r, 0);
+    const int cx1 = MIN(x1 + r, w);
+    const int cols = cx1 - cx0;
+    const int rw = x1 - x0;
+    const int padWidth = rw + 2 * r;
+    const int padLeft = cx0 - (x0 - r);
+    const int padRight = (x1 + r) - cx1;
+
+    // Ring of converted source rows, source row j lives in slot j % ksize
+    short *ring = (short *)malloc((size_t)ksize * cols * sizeof(short));
+    int loaded[5];
+    for (int i = 0; i < ksize; i++) {
+        loaded[i] = -1;
+    }
+
+    // Vertical pass results
+    short *vSmooth = (short *)malloc((size_t)padWidth * sizeof(short));
+    short *vDiff = (short *)malloc((size_t)padWidth * sizeof(short));
+    short *rowDx = (short *)malloc((size_t)rw * sizeof(short));
+    short *rowDy = (short *)malloc((size_t)rw * sizeof(short));
+    const short *rows[5];
+
+    for (int y = y0; y < y1; y++) {
+        for (int k = 0; k < ksize; k++) {
+            const int j = MIN(MAX(y + k - r, 0), h - 1);
+            const int slot = j % ksize;
+            if (loaded[slot] != j) {
+                loadGrayRow(image, j, cx0, cx1, ring + slot * cols);
+                loaded[slot] = j;
+            }
+            rows[k] = ring + slot * cols;
+        }
+
+        short *sm = vSmooth + padLeft;
+        short *df = vDiff + padLeft;
+        for (int x = 0; x < cols; x++) {
+            sm[x] = (short)(kernel.smooth[0] * rows[0][x]);
+            df[x] = (short)(kernel.diff[0] * rows[0][x]);
+        }
+        for (int k = 1; k < ksize; k++) {
+            const short *src = rows[k];
+            const short cs = kernel.smooth[k];
+            const short cd = kernel.diff[k];
+            for (int x = 0; x < cols; x++) {
+                sm[x] = (short)(sm[x] + cs * src[x]);
+                df[x] = (short)(df[x] + cd * src[x]);
+            }
+        }
+        for (int i = 1; i <= padLeft; i++) {
+            sm[-i] = sm[0];
+            df[-i] = df[0];
+        }
+        for (int i = 0; i < padRight; i++) {
+            sm[cols + i] = sm[cols - 1];
+            df[cols + i] = df[cols - 1];
+        }
+
+        // Horizontal pass
+        short *outDx = NULL != dx ? dx + y * w + x0 : rowDx;
+        short *outDy = NULL != dy ? dy + y * w + x0 : rowDy;
+        for (int x = 0; x < rw; x++) {
+            outDx[x] = (short)(kernel.diff[0] * vSmooth[x]);
+            outDy[x] = (short)(kernel.smooth[0] * vDiff[x]);
+        }
+        for (int k = 1; k < ksize; k++) {
+            const short *sk = vSmooth + k;
+            const short *dk = vDiff + k;
+            const short cs = kernel.smooth[k];
+            const short cd = kernel.diff[k];
+            for (int x = 0; x < rw; x++) {
+                outDx[x] = (short)(outDx[x] + cd * sk[x]);
+                outDy[x] = (short)(outDy[x] + cs * dk[x]);
+            }
+        }
+
+        if (NULL != magnitude) {
+            short *outMag = magnitude + y * w + x0;
+            for (int x = 0; x < rw; x++) {
+                const float fx = outDx[x];
+                const float fy = outDy[x];
+                outMag[x] = (short)(sqrtf(fx * fx + fy * fy) + 0.5f);
+            }
+        }
+    }
+
+    free(ring);
+    free(vSmooth);
+    free(vDiff);
+    free(rowDx);
+    free(rowDy);
+}
+
+#pragma mark-- Morphology
+
+void scvErode(const ScvImage *src, ScvImage *dst, ScvSize kernel) { erodeImage(src, dst, kernel, 0); }
+
+void scvDilate(const ScvImage *src, ScvImage *dst, ScvSize kernel) { erodeImage(src, dst, kernel, 255); }
+
+void scvMorphology(const ScvImage *src, ScvImage *dst, SCV_MORPH_TYPE type, ScvSize kernel) {
+    switch (type) {
+    case SCV_MORPH_ERODE:
+        scvErode(src, dst, kernel);
+        break;
+    case SCV_MORPH_DILATE:
+        scvDilate(src, dst, kernel);
+        break;
+    case SCV_MORPH_OPEN:
+        scvErode(src, dst, kernel);
+        scvDilate(dst, dst, kernel);
+        break;
+    case SCV_MORPH_CLOSE:
+        scvDilate(src, dst, kernel);
+        scvErode(dst, dst, kernel);
+        break;
+    case SCV_MORPH_GRADIENT: {
+        ScvImage *eroded = scvCreateImage(scvGetSize(src));
+        scvErode(src, eroded, kernel);
+        scvDilate(src, dst, kernel);
+        const int n = src->width * 3;
+        for (int y = 0; y < src->height; y++) {
+            ScvUByte *d = (ScvUByte *)scvGetRowRef(dst, y);
+            const ScvUByte *e = (const ScvUByte *)scvGetRowRef(eroded, y);
+            for (int i = 0; i < n; i++) {
+                d[i] = (ScvUByte)(d[i] - e[i]);
+            }
+        }
+        scvReleaseImage(eroded);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+#pragma mark-- Filter
+
+void scvFilter2D(const ScvImage *src, ScvImage *dst, const ScvMat *kernel) {
+    if (src->width != dst->width || src->height != dst->height || kernel->rows <= 0 || kernel->cols <= 0
+        || src->width <= 0 || src->height <= 0) {
+        return;
+    }
+
+    // Filtered in float, which also leaves src intact when it is dst
+    const ScvSize size = scvGetSize(src);
+    ScvImage *in = scvCreateImageWithDepth(size, SCV_DEPTH_32F);
+    ScvImage *out = scvCreateImageWithDepth(size, SCV_DEPTH_32F);
+    scvConvertImage(src, in, 1.0f, 0.0f);
+
+    float *col = (float *)malloc(sizeof(float) * (kernel->rows + kernel->cols));
+    float *row = col + kernel->rows;
+    if (kernel->rows * kernel->cols > 1 && separateKernel(kernel, col, row)) {
+        filterSeparable(in, out, col, kernel->rows, row, kernel->cols);
+    } else if (kernel->rows * kernel->cols <= FILTER_DIRECT_MAX_AREA) {
+        filterDirect(in, out, kernel);
+    } else {
+        filterFFT(in, out, kernel);
+    }
+    free(col);
+
+    scvConvertImage(out, dst, 1.0f, 0.0f);
+    scvReleaseImage(in);
+    scvReleaseImage(out);
+}
+
+void scvBilateralFilter(const ScvImage *src, ScvImage *dst, float sigmaSpace, float sigmaColor) {
+    if (src->width != dst->width || src->height != dst->height || src->width <= 0 || src->height <= 0) {
+        return;
+    }
+
+    const int w = src->width, h = src->height;
+    const ScvSize size = scvGetSize(src);
+    ScvImage *values = scvCreateImageWithDepth(size, SCV_DEPTH_32F);
+    // Luminance guides the color channels, so gray images get the plain bilateral filter
+    float *lum = (float *)malloc(sizeof(float) * w * h);
+    if (NULL == values || NULL == lum) {
+        free(lum);
+        scvReleaseImage(values);
+        return;
+    }
+    scvConvertImage(src, values, 1.0f, 0.0f);
+
+    float lo = INFINITY, hi = -INFINITY;
+    for (int y = 0; y < h; y++) {
+        const float *row = (const float *)scvGetRowRef(values, y);
+        for (int x = 0; x < w; x++) {
+            const float v = 0.114f * row[x * 3] + 0.587f * row[x * 3 + 1] + 0.299f * row[x * 3 + 2];
+            lum[y * w + x] = v;
+            lo = MIN(lo, v);
+            hi = MAX(hi, v);
+        }
+    }
+
+    const float cellRange = MAX(MAX(sigmaColor, 1e-6f), (hi - lo) / (BILATERAL_MAX_DEPTH - 1));
+    BilateralGrid grid;
+    // Pixels are splatted to the nearest cell, the last one is at the rounded extent
+    grid.depth = (int)((hi - lo) / cellRange + 0.5f) + 1 + BILATERAL_PAD * 2;
+    // Start from the cell size that spreads the budget over the image and grow it until the padded grid fits
+    float cellSize = MAX(MAX(sigmaSpace, 1.0f), sqrtf((float)w * h * grid.depth / BILATERAL_MAX_CELLS));
+    for (;;) {
+        grid.width = (int)((w - 1) / cellSize + 0.5f) + 1 + BILATERAL_PAD * 2;
+        grid.height = (int)((h - 1) / cellSize + 0.5f) + 1 + BILATERAL_PAD * 2;
+        if ((double)grid.width * grid.height * grid.depth <= BILATERAL_MAX_CELLS) {
+            break;
+        }
+        cellSize *= 1.05f;
+    }
+    const size_t rowCells = (size_t)grid.width * grid.depth;
+    grid.cells = (float *)calloc(rowCells * grid.height * 4, sizeof(float));
+    if (NULL == grid.cells) {
+        free(lum);
+        scvReleaseImage(values);
+        return;
+    }
+
+    // Splat every pixel to its nearest cell
+    for (int y = 0; y < h; y++) {
+        const float *row = (const float *)scvGetRowRef(values, y);
+        const int cy = (int)(y / cellSize + 0.5f) + BILATERAL_PAD;
+        for (int x = 0; x < w; x++) {
+            const int cx = (int)(x / cellSize + 0.5f) + BILATERAL_PAD;
+            const int cz = (int)((lum[y * w + x] - lo) / cellRange + 0.5f) + BILATERAL_PAD;
+            float *cell = grid.cells + (cy * rowCells + (size_t)cx * grid.depth + cz) * 4;
+            cell[0] += row[x * 3];
+            cell[1] += row[x * 3 + 1];
+            cell[2] += row[x * 3 + 2];
+            cell[3] += 1.0f;
+        }
+    }
+
+    blurGrid(&grid);
+
+    // Slice the grid back at every pixel with trilinear interpolation
+    int y;
+#pragma omp parallel for schedule(static)
+    for (y = 0; y < h; y++) {
+        float *row = (float *)scvGetRowRef(values, y);
+        const float gy = y / cellSize + BILATERAL_PAD;
+        const int y0 = (int)gy;
+        const float ay = gy - y0;
+        for (int x = 0; x < w; x++) {
+            const float gx = x / cellSize + BILATERAL_PAD;
+            const float gz = (lum[y * w + x] - lo) / cellRange + BILATERAL_PAD;
+            const int x0 = (int)gx, z0 = (int)gz;
+            const float ax = gx - x0, az = gz - z0;
+
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int k = 0; k < 8; k++) {
+                const int dx = k & 1, dy = k >> 1 & 1, dz = k >> 2;
+                const float weight = (dx ? ax : 1.0f - ax) * (dy ? ay : 1.0f - ay) * (dz ? az : 1.0f - az);
+                const float *cell = grid.cells + ((y0 + dy) * rowCells + (size_t)(x0 + dx) * grid.depth + z0 + dz) * 4;
+                for (int c = 0; c < 4; c++) {
+                    sum[c] += cell[c] * weight;
+                }
+            }
+            if (sum[3] > 1e-6f) {
+                for (int c = 0; c < 3; c++) {
+                    row[x * 3 + c] = sum[c] / sum[3];
+                }
+            }
+        }
+    }
+
+    scvConvertImage(values, dst, 1.0f, 0.0f);
+    free(grid.cells);
+    free(lum);
+    scvReleaseImage(values);
+}
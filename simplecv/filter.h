@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "types.h"
+
+#ifndef SIMPLECV_FILTER_H
+#define SIMPLECV_FILTER_H
+
+#pragma mark - Gradient
+
+/**
+ * Calculates the derivatives of a gray-scaled image with a separable Sobel (3x3 or 5x5) or Scharr (3x3) kernel,
+ * border pixels are replicated.
+ * dx, dy and magnitude are width * height buffers, row by row from the logical top,
+ * any of them can be NULL if not needed. magnitude is the rounded L2 norm of (dx, dy).
+ */
+void scvSobel(const ScvImage *image, short *dx, short *dy, short *magnitude, SCV_SOBEL_TYPE type);
+
+/**
+ * Same as scvSobel but only calculates the pixels inside rect, the rest of the buffers is left untouched.
+ * Pixels around rect are read from the image, only the image border is replicated.
+ */
+void scvSobelRect(const ScvImage *image, ScvRect rect, short *dx, short *dy, short *magnitude, SCV_SOBEL_TYPE type);
+
+#pragma mark - Morphology
+
+/**
+ * Morphological operations with a rectangular structuring element of the given size,
+ * anchored at its center. Every channel is processed, so they work for binary, gray and color images.
+ * The cost per pixel does not depend on the kernel size (van Herk/Gil-Werman algorithm).
+ * src and dst can be the same image.
+ */
+void scvErode(const ScvImage *src, ScvImage *dst, ScvSize kernel);
+
+void scvDilate(const ScvImage *src, ScvImage *dst, ScvSize kernel);
+
+void scvMorphology(const ScvImage *src, ScvImage *dst, SCV_MORPH_TYPE type, ScvSize kernel);
+
+#pragma mark - Filter
+
+/**
+ * Correlates every channel with kernel (not flipped, like OpenCV's filter2D) anchored at its center,
+ * border pixels are replicated. Works for any depth, the result is rounded and saturated to the depth of dst.
+ * Separable (rank-1) kernels run as two 1-D passes, small ones directly and large ones through FFT.
+ * src may be dst.
+ */
+void scvFilter2D(const ScvImage *src, ScvImage *dst, const ScvMat *kernel);
+
+/**
+ * Edge-preserving smoothing, a bilateral filter approximated with a bilateral grid:
+ * pixels are averaged into cells of sigmaSpace pixels by sigmaColor luminance values,
+ * the grid is blurred and read back with trilinear interpolation, so the cost hardly grows with sigmaSpace.
+ * sigmaColor is in the values of the depth, e.g. 0 ~ 255 for SCV_DEPTH_8U. Color images are guided
+ * by their luminance. The luminance axis has at most 256 cells and the whole grid at most 2^24 (256 MB),
+ * so on large images small sigmaSpace values are raised to fit. dst is left unchanged if the memory cannot be
+ * allocated. src and dst can be the same image.
+ */
+void scvBilateralFilter(const ScvImage *src, ScvImage *dst, float sigmaSpace, float sigmaColor);
+
+#endif // SIMPLECV_FILTER_H
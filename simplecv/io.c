@@ -22,20 +22,34 @@
 // Created by Richard Chien on 6/20/16.
 //
 
+// 64-bit file offsets for fseeko and ftello on 32-bit systems
+#define _FILE_OFFSET_BITS 64
+
+#include <ctype.h>
+#include <memory.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "core.h"
 #include "io.h"
 
 #pragma mark - Inner
 
+#define MIN(val1, val2) ((val1) > (val2) ? (val2) : (val1))
+#define MAX(val1, val2) ((val1) > (val2) ? (val1) : (val2))
+
 typedef signed char Int8;
 typedef short Int16;
 typedef int Int32;
 #ifdef _WIN32
 typedef __int64 Int64;
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
 #else
 typedef long long Int64;
+#define fseek64 fseeko
+#define ftell64 ftello
 #endif
 
 #pragma pack(push)
@@ -64,59 +78,1078 @@ typedef struct _BitmapInfoHeader {
 
 #pragma pack(pop)
 
-ScvBool saveImageToBmp(ScvImage *image, const char *filename) {
-    int imageByteCount = image->widthBytes * image->height;
+#define BI_RGB 0
+#define BI_BITFIELDS 3
+
+// Larger widths and heights are rejected, so that the byte sizes of file and image rows fit an int
+#define BMP_MAX_DIMENSION (1 << 28)
+
+int bmpStride(int width, int bitCount) { return (int)((((Int64)width * bitCount + 31) / 32) * 4); }
+
+/**
+ * Row converters between BMP rows and image rows.
+ * Pixels are moved with overlapping 4-byte copies, which compile to single loads and stores,
+ * the last pixel is copied byte by byte so that nothing is written past the row.
+ */
+
+void expandPaletteRow(const ScvUByte *src, ScvUByte *dst, int width, const unsigned int *palette) {
+    for (int x = 0; x < width - 1; x++) {
+        memcpy(dst + x * 3, &palette[src[x]], 4);
+    }
+    if (width > 0) {
+        const ScvUByte *last = (const ScvUByte *)&palette[src[width - 1]];
+        dst[(width - 1) * 3] = last[0];
+        dst[(width - 1) * 3 + 1] = last[1];
+        dst[(width - 1) * 3 + 2] = last[2];
+    }
+}
+
+void packBgrxRow(const ScvUByte *src, ScvUByte *dst, int width) {
+    for (int x = 0; x < width - 1; x++) {
+        memcpy(dst + x * 3, src + x * 4, 4);
+    }
+    if (width > 0) {
+        dst[(width - 1) * 3] = src[(width - 1) * 4];
+        dst[(width - 1) * 3 + 1] = src[(width - 1) * 4 + 1];
+        dst[(width - 1) * 3 + 2] = src[(width - 1) * 4 + 2];
+    }
+}
+
+void unpackBgrxRow(const ScvUByte *src, ScvUByte *dst, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x * 4] = src[x * 3];
+        dst[x * 4 + 1] = src[x * 3 + 1];
+        dst[x * 4 + 2] = src[x * 3 + 2];
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+void grayRow(const ScvUByte *src, ScvUByte *dst, int width) {
+    // Same weights as SCV_GRAYING_W_AVG in fixed point, exact for gray pixels
+    for (int x = 0; x < width; x++) {
+        dst[x] = (ScvUByte)((28 * src[x * 3] + 151 * src[x * 3 + 1] + 77 * src[x * 3 + 2] + 128) >> 8);
+    }
+}
+
+/**
+ * Byte sources and sinks let the codecs work on files and memory buffers alike.
+ * A memory source hands out pointers into its buffer, so rows are converted without an extra copy.
+ */
+
+typedef struct _ByteSource {
+    FILE *file;
+    const ScvUByte *data;
+    size_t size;
+    size_t pos;
+} ByteSource;
+
+typedef struct _ByteSink {
+    FILE *file;
+    ScvUByte *data;
+    size_t size;
+    size_t capacity;
+} ByteSink;
+
+ByteSource fileSource(FILE *file) {
+    ByteSource source = {file, NULL, 0, 0};
+    return source;
+}
+
+ByteSource memorySource(const void *data, size_t size) {
+    ByteSource source = {NULL, (const ScvUByte *)data, size, 0};
+    return source;
+}
+
+/**
+ * Returns the next n bytes, read into scratch for a file source, or NULL if there are not enough.
+ */
+const ScvUByte *sourceNext(ByteSource *source, void *scratch, size_t n) {
+    if (source->file) {
+        return fread(scratch, 1, n, source->file) == n ? (const ScvUByte *)scratch : NULL;
+    }
+    if (n > source->size - source->pos) {
+        return NULL;
+    }
+    const ScvUByte *result = source->data + source->pos;
+    source->pos += n;
+    return result;
+}
+
+ScvBool sourceRead(ByteSource *source, void *dst, size_t n) {
+    const ScvUByte *bytes = sourceNext(source, dst, n);
+    if (NULL != bytes && bytes != dst) {
+        memcpy(dst, bytes, n);
+    }
+    return NULL != bytes;
+}
+
+ScvBool sourceSeek(ByteSource *source, size_t offset) {
+    if (source->file) {
+        return 0 == fseek64(source->file, (Int64)offset, SEEK_SET);
+    }
+    if (offset > source->size) {
+        return SCV_FALSE;
+    }
+    source->pos = offset;
+    return SCV_TRUE;
+}
+
+size_t sourceTell(ByteSource *source) {
+    return source->file ? (size_t)ftell64(source->file) : source->pos;
+}
+
+/**
+ * Whether n more bytes can be read, known for memory sources only, so that untrusted sizes are checked
+ * before anything is allocated for them. A file that is too short fails later, when it is read.
+ */
+ScvBool sourceHas(const ByteSource *source, size_t n) {
+    return source->file || n <= source->size - source->pos;
+}
+
+ByteSink fileSink(FILE *file) {
+    ByteSink sink = {file, NULL, 0, 0};
+    return sink;
+}
+
+ByteSink memorySink(size_t capacity) {
+    ByteSink sink = {NULL, (ScvUByte *)malloc(MAX(capacity, 1)), 0, MAX(capacity, 1)};
+    return sink;
+}
+
+ScvBool sinkWrite(ByteSink *sink, const void *src, size_t n) {
+    if (sink->file) {
+        return fwrite(src, 1, n, sink->file) == n;
+    }
+    if (n > sink->capacity - sink->size) {
+        while (n > sink->capacity - sink->size) {
+            sink->capacity *= 2;
+        }
+        sink->data = (ScvUByte *)realloc(sink->data, sink->capacity);
+    }
+    memcpy(sink->data + sink->size, src, n);
+    sink->size += n;
+    return SCV_TRUE;
+}
 
+size_t bmpFileSize(const ScvImage *image, int bitCount) {
+    return sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader) + (8 == bitCount ? 256 * 4 : 0)
+           + (size_t)bmpStride(image->width, bitCount) * image->height;
+}
+
+/**
+ * Writes the headers (and the gray palette of 8-bit files), the rows follow in file order.
+ * Files over 4 GB get the largest bfSize and a biSizeImage of 0, which is allowed for BI_RGB,
+ * readers take the size from the dimensions then.
+ */
+ScvBool writeBmpHeader(ByteSink *sink, int width, int height, int origin, int bitCount) {
+    const int paletteSize = 8 == bitCount ? 256 * 4 : 0;
+    const Int32 offBits = (Int32)(sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader)) + paletteSize;
+    const Int64 imageSize = (Int64)bmpStride(width, bitCount) * height;
+
+    // The sizes are unsigned in the file
     BitmapFileHeader fileHeader = {0};
     fileHeader.bfType = 0x4D42; // "BM"
-    fileHeader.bfSize = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader) + imageByteCount;
-    fileHeader.bfOffBits = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    fileHeader.bfOffBits = offBits;
+    fileHeader.bfSize = (Int32)(unsigned int)MIN(offBits + imageSize, 0xFFFFFFFFLL);
 
     BitmapInfoHeader infoHeader = {0};
     infoHeader.biSize = sizeof(BitmapInfoHeader);
-    infoHeader.biHeight = image->origin ? image->height : -image->height;
-    infoHeader.biWidth = image->width;
+    infoHeader.biHeight = origin ? height : -height;
+    infoHeader.biWidth = width;
     infoHeader.biPlanes = 1;
-    infoHeader.biBitCount = 24;
-    infoHeader.biSizeImage = imageByteCount;
-    infoHeader.biCompression = 0;
-
-    FILE *bmpFile = fopen(filename, "wb");
-    if (NULL != bmpFile) {
-        fwrite(&fileHeader, sizeof(BitmapFileHeader), 1, bmpFile);
-        fwrite(&infoHeader, sizeof(BitmapInfoHeader), 1, bmpFile);
-        fwrite(image->data, (size_t)imageByteCount, 1, bmpFile);
-        fclose(bmpFile);
+    infoHeader.biBitCount = (Int16)bitCount;
+    infoHeader.biSizeImage = imageSize > 0xFFFFFFFFLL ? 0 : (Int32)(unsigned int)imageSize;
+    infoHeader.biCompression = BI_RGB;
+    infoHeader.biClrUsed = 8 == bitCount ? 256 : 0;
+
+    ScvBool ok = sinkWrite(sink, &fileHeader, sizeof(BitmapFileHeader));
+    ok = ok && sinkWrite(sink, &infoHeader, sizeof(BitmapInfoHeader));
+    if (8 == bitCount) {
+        unsigned int palette[256];
+        for (int i = 0; i < 256; i++) {
+            palette[i] = (unsigned int)(i | i << 8 | i << 16);
+        }
+        ok = ok && sinkWrite(sink, palette, sizeof(palette));
+    }
+    return ok;
+}
+
+ScvBool saveImageToBmp(const ScvImage *image, ByteSink *sink, int bitCount) {
+    if ((8 != bitCount && 24 != bitCount && 32 != bitCount) || SCV_DEPTH_8U != image->depth) {
+        return SCV_FALSE;
+    }
+
+    const int w = image->width;
+    const int h = image->height;
+    const int stride = bmpStride(w, bitCount);
+
+    ScvBool ok = writeBmpHeader(sink, w, h, image->origin, bitCount);
+
+    if (24 == bitCount && stride == image->widthBytes) {
+        ok = ok && sinkWrite(sink, image->data, (size_t)stride * h);
+    } else {
+        // Rows are written in the order they are stored, which is the order of the file
+        ScvUByte *row = (ScvUByte *)malloc((size_t)stride);
+        memset(row, 0, (size_t)stride);
+        for (int i = 0; i < h && ok; i++) {
+            const ScvUByte *src = (const ScvUByte *)image->data + i * image->widthBytes;
+            switch (bitCount) {
+            case 8:
+                grayRow(src, row, w);
+                break;
+            case 32:
+                unpackBgrxRow(src, row, w);
+                break;
+            default:
+                memcpy(row, src, (size_t)w * 3);
+                break;
+            }
+            ok = sinkWrite(sink, row, (size_t)stride);
+        }
+        free(row);
+    }
+    return ok;
+}
+
+/**
+ * Reads and validates the headers, leaves the source at the start of the pixel data.
+ */
+ScvBool readBmpHeader(ByteSource *source, BitmapInfoHeader *infoHeader, unsigned int *palette) {
+    BitmapFileHeader fileHeader;
+    if (!sourceRead(source, &fileHeader, sizeof(BitmapFileHeader))
+        || !sourceRead(source, infoHeader, sizeof(BitmapInfoHeader)) || 0x4D42 != fileHeader.bfType) {
+        return SCV_FALSE;
+    }
+
+    // Uncompressed 8-bit indexed, 24-bit and 32-bit (BGRX, or BGRA with the standard masks) only
+    const int bitCount = infoHeader->biBitCount;
+    const int compression = infoHeader->biCompression;
+    if (!((8 == bitCount && BI_RGB == compression) || (24 == bitCount && BI_RGB == compression)
+          || (32 == bitCount && (BI_RGB == compression || BI_BITFIELDS == compression)))
+        || infoHeader->biWidth <= 0 || infoHeader->biWidth > BMP_MAX_DIMENSION || 0 == infoHeader->biHeight
+        || infoHeader->biHeight > BMP_MAX_DIMENSION || infoHeader->biHeight < -BMP_MAX_DIMENSION
+        || infoHeader->biSize < (Int32)sizeof(BitmapInfoHeader) || fileHeader.bfOffBits <= 0) {
+        return SCV_FALSE;
+    }
+
+    // The red, green and blue masks follow the 40-byte header, also within its larger versions
+    if (BI_BITFIELDS == compression) {
+        unsigned int masks[3];
+        if (!sourceSeek(source, sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader))
+            || !sourceRead(source, masks, sizeof(masks)) || 0x00FF0000 != masks[0] || 0x0000FF00 != masks[1]
+            || 0x000000FF != masks[2]) {
+            return SCV_FALSE;
+        }
+    }
+
+    // The palette follows the info header, which may be a larger version than ours
+    if (8 == bitCount) {
+        int colors = infoHeader->biClrUsed > 0 && infoHeader->biClrUsed <= 256 ? infoHeader->biClrUsed : 256;
+        memset(palette, 0, 256 * sizeof(unsigned int));
+        if (!sourceSeek(source, sizeof(BitmapFileHeader) + (size_t)infoHeader->biSize)
+            || !sourceRead(source, palette, sizeof(unsigned int) * colors)) {
+            return SCV_FALSE;
+        }
+    }
+    return sourceSeek(source, (size_t)fileHeader.bfOffBits);
+}
+
+/**
+ * Converts the pixels x0 ~ x0 + width - 1 of a BMP row to an image row.
+ */
+void convertBmpRow(const ScvUByte *row, ScvUByte *dst, int x0, int width, int bitCount, const unsigned int *palette) {
+    switch (bitCount) {
+    case 8:
+        expandPaletteRow(row + x0, dst, width, palette);
+        break;
+    case 32:
+        packBgrxRow(row + x0 * 4, dst, width);
+        break;
+    default:
+        memcpy(dst, row + x0 * 3, (size_t)width * 3);
+        break;
+    }
+}
+
+/**
+ * What is needed to read any rows of a BMP file after its headers.
+ */
+typedef struct _BmpLayout {
+    int width;
+    int height;
+    int origin; // 1 if the rows are stored bottom-up
+    int bitCount;
+    int stride;
+    size_t pixelOffset;
+    unsigned int palette[256];
+} BmpLayout;
+
+ScvBool readBmpLayout(ByteSource *source, BmpLayout *layout) {
+    BitmapInfoHeader infoHeader;
+    if (!readBmpHeader(source, &infoHeader, layout->palette)) {
+        return SCV_FALSE;
+    }
+    layout->width = infoHeader.biWidth;
+    layout->height = infoHeader.biHeight > 0 ? infoHeader.biHeight : -infoHeader.biHeight;
+    layout->origin = infoHeader.biHeight > 0 ? 1 : 0;
+    layout->bitCount = infoHeader.biBitCount;
+    layout->stride = bmpStride(layout->width, layout->bitCount);
+    layout->pixelOffset = sourceTell(source);
+    return SCV_TRUE;
+}
+
+/**
+ * Reads the logical rows y0 ~ y1 - 1 (from the top), columns x0 ~ x0 + band->width - 1, into the rows of band.
+ * The rows are contiguous in the file either way, so it is one seek and a sequential read.
+ */
+ScvBool readBmpRows(ByteSource *source, const BmpLayout *layout, int y0, int y1, int x0, ScvImage *band) {
+    const int fileRow0 = layout->origin ? layout->height - y1 : y0;
+    if (!sourceSeek(source, layout->pixelOffset + (size_t)fileRow0 * layout->stride)) {
+        return SCV_FALSE;
+    }
+
+    ScvUByte *scratch = (ScvUByte *)malloc((size_t)layout->stride);
+    ScvBool ok = SCV_TRUE;
+    for (int i = 0; i < y1 - y0 && ok; i++) {
+        const int y = layout->origin ? y1 - 1 - i : y0 + i;
+        const ScvUByte *row = sourceNext(source, scratch, (size_t)layout->stride);
+        ok = NULL != row;
+        if (ok) {
+            ScvUByte *dst = (ScvUByte *)scvGetRowRef(band, y - y0);
+            convertBmpRow(row, dst, x0, band->width, layout->bitCount, layout->palette);
+        }
+    }
+    free(scratch);
+    return ok;
+}
+
+ScvImage *readImageFromBmp(ByteSource *source) {
+    BitmapInfoHeader infoHeader;
+    unsigned int palette[256];
+    if (!readBmpHeader(source, &infoHeader, palette)) {
+        return NULL;
+    }
+
+    const int bitCount = infoHeader.biBitCount;
+    const int w = infoHeader.biWidth;
+    const int h = infoHeader.biHeight;
+    const int stride = bmpStride(w, bitCount);
+    ScvImage *image = NULL;
+    if (sourceHas(source, (size_t)stride * (h > 0 ? h : -h))) {
+        image = scvCreateImage(scvSize(w, h > 0 ? h : -h));
+    }
+    if (NULL == image) {
+        return NULL;
+    }
+    image->origin = h > 0 ? 1 : 0;
+
+    ScvBool ok = SCV_TRUE;
+    if (24 == bitCount && stride == image->widthBytes) {
+        ok = sourceRead(source, image->data, (size_t)stride * image->height);
+    } else if (24 == bitCount) {
+        // Image rows are at least as wide as BMP rows, so the BMP padding lands in the image padding
+        for (int i = 0; i < image->height && ok; i++) {
+            ok = sourceRead(source, (ScvUByte *)image->data + i * image->widthBytes, (size_t)stride);
+        }
+    } else {
+        ScvUByte *scratch = (ScvUByte *)malloc((size_t)stride);
+        for (int i = 0; i < image->height && ok; i++) {
+            ScvUByte *dst = (ScvUByte *)image->data + i * image->widthBytes;
+            const ScvUByte *row = sourceNext(source, scratch, (size_t)stride);
+            if (NULL == row) {
+                ok = SCV_FALSE;
+                break;
+            }
+            convertBmpRow(row, dst, 0, w, bitCount, palette);
+        }
+        free(scratch);
+    }
+
+    if (!ok) {
+        scvReleaseImage(image);
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * SCVI, a lossless format for intermediate images, based on QOI (https://qoiformat.org).
+ * The image is cut into stripes of whole rows which are coded independently,
+ * so that they can be encoded and decoded in parallel:
+ *
+ *     "SCVI" | width | height | stripe rows | stripe count | byte size of every stripe | stripes...
+ *
+ * Every stripe starts from a black previous pixel and an empty index, and runs never cross stripes.
+ */
+
+#define SCVI_MAGIC 0x49564353 // "SCVI"
+#define SCVI_STRIPE_PIXELS (1 << 16)
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_MASK_2 0xc0
+#define QOI_RUN_MAX 62
+
+#define QOI_HASH(p) (((p).r * 3 + (p).g * 5 + (p).b * 7 + 255 * 11) % 64)
+
+typedef struct _ScviHeader {
+    Int32 magic;
+    Int32 width;
+    Int32 height;
+    Int32 stripeRows;
+    Int32 stripeCount;
+} ScviHeader;
+
+int samePixel(ScvPixel a, ScvPixel b) { return a.b == b.b && a.g == b.g && a.r == b.r; }
+
+/**
+ * Encodes rows [y0, y1) into out, which must hold 4 bytes per pixel.
+ * Returns the byte size.
+ */
+int encodeScviStripe(const ScvImage *image, int y0, int y1, ScvUByte *out) {
+    ScvPixel index[64];
+    memset(index, 0, sizeof(index));
+    ScvPixel prev = scvPixelAll(0);
+    int run = 0;
+    int p = 0;
+
+    for (int y = y0; y < y1; y++) {
+        const ScvPixel *row = scvGetRowRef(image, y);
+        for (int x = 0; x < image->width; x++) {
+            const ScvPixel px = row[x];
+            if (samePixel(px, prev)) {
+                if (++run == QOI_RUN_MAX) {
+                    out[p++] = (ScvUByte)(QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                out[p++] = (ScvUByte)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+
+            const int h = QOI_HASH(px);
+            if (samePixel(index[h], px)) {
+                out[p++] = (ScvUByte)(QOI_OP_INDEX | h);
+            } else {
+                index[h] = px;
+                const ScvByte dr = (ScvByte)(px.r - prev.r);
+                const ScvByte dg = (ScvByte)(px.g - prev.g);
+                const ScvByte db = (ScvByte)(px.b - prev.b);
+                const ScvByte drDg = (ScvByte)(dr - dg);
+                const ScvByte dbDg = (ScvByte)(db - dg);
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                    out[p++] = (ScvUByte)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                } else if (drDg > -9 && drDg < 8 && dg > -33 && dg < 32 && dbDg > -9 && dbDg < 8) {
+                    out[p++] = (ScvUByte)(QOI_OP_LUMA | (dg + 32));
+                    out[p++] = (ScvUByte)((drDg + 8) << 4 | (dbDg + 8));
+                } else {
+                    out[p++] = QOI_OP_RGB;
+                    out[p++] = px.r;
+                    out[p++] = px.g;
+                    out[p++] = px.b;
+                }
+            }
+            prev = px;
+        }
+    }
+
+    if (run > 0) {
+        out[p++] = (ScvUByte)(QOI_OP_RUN | (run - 1));
+    }
+    return p;
+}
+
+/**
+ * Decodes rows [y0, y1) from size bytes of in.
+ */
+ScvBool decodeScviStripe(const ScvUByte *in, int size, ScvImage *image, int y0, int y1) {
+    ScvPixel index[64];
+    memset(index, 0, sizeof(index));
+    ScvPixel px = scvPixelAll(0);
+    int run = 0;
+    int p = 0;
+
+    for (int y = y0; y < y1; y++) {
+        ScvPixel *row = scvGetRowRef(image, y);
+        for (int x = 0; x < image->width; x++) {
+            if (run > 0) {
+                run--;
+                row[x] = px;
+                continue;
+            }
+            if (p >= size) {
+                return SCV_FALSE;
+            }
+
+            const int b1 = in[p++];
+            if (QOI_OP_RGB == b1) {
+                if (p + 3 > size) {
+                    return SCV_FALSE;
+                }
+                px.r = in[p];
+                px.g = in[p + 1];
+                px.b = in[p + 2];
+                p += 3;
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                px = index[b1];
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                px.r = (ScvUByte)(px.r + ((b1 >> 4) & 0x03) - 2);
+                px.g = (ScvUByte)(px.g + ((b1 >> 2) & 0x03) - 2);
+                px.b = (ScvUByte)(px.b + (b1 & 0x03) - 2);
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                if (p >= size) {
+                    return SCV_FALSE;
+                }
+                const int b2 = in[p++];
+                const int dg = (b1 & 0x3f) - 32;
+                px.r = (ScvUByte)(px.r + dg - 8 + ((b2 >> 4) & 0x0f));
+                px.g = (ScvUByte)(px.g + dg);
+                px.b = (ScvUByte)(px.b + dg - 8 + (b2 & 0x0f));
+            } else {
+                run = b1 & 0x3f;
+            }
+
+            index[QOI_HASH(px)] = px;
+            row[x] = px;
+        }
+    }
+    return SCV_TRUE;
+}
+
+ScvBool saveImageToScvi(const ScvImage *image, ByteSink *sink) {
+    if (SCV_DEPTH_8U != image->depth) {
+        return SCV_FALSE;
+    }
+
+    const int w = image->width;
+    const int h = image->height;
+
+    ScviHeader header;
+    header.magic = SCVI_MAGIC;
+    header.width = w;
+    header.height = h;
+    header.stripeRows = w > 0 ? MAX(SCVI_STRIPE_PIXELS / w, 1) : 1;
+    header.stripeCount = (h + header.stripeRows - 1) / header.stripeRows;
+
+    const int stripeCount = header.stripeCount;
+    const size_t stripeCapacity = (size_t)header.stripeRows * w * 4;
+    ScvUByte *data = (ScvUByte *)malloc(stripeCapacity * MAX(stripeCount, 1));
+    Int32 *sizes = (Int32 *)malloc(MAX(stripeCount, 1) * sizeof(Int32));
+
+    int s;
+#pragma omp parallel for schedule(dynamic)
+    for (s = 0; s < stripeCount; s++) {
+        const int y0 = s * header.stripeRows;
+        sizes[s] = encodeScviStripe(image, y0, MIN(y0 + header.stripeRows, h), data + s * stripeCapacity);
+    }
+
+    ScvBool ok = sinkWrite(sink, &header, sizeof(header));
+    ok = ok && sinkWrite(sink, sizes, sizeof(Int32) * stripeCount);
+    for (s = 0; s < stripeCount && ok; s++) {
+        ok = sinkWrite(sink, data + s * stripeCapacity, (size_t)sizes[s]);
+    }
+
+    free(data);
+    free(sizes);
+    return ok;
+}
+
+ScvBool readScviHeader(ByteSource *source, ScviHeader *header) {
+    return sourceRead(source, header, sizeof(ScviHeader)) && SCVI_MAGIC == header->magic && header->width > 0
+           && header->height > 0 && header->stripeRows > 0
+           && header->stripeCount == (header->height + header->stripeRows - 1) / header->stripeRows;
+}
+
+/**
+ * Reads the stripe sizes after the header, offsets[s] is where stripe s starts after them.
+ */
+ScvBool readScviStripeSizes(ByteSource *source, const ScviHeader *header, Int32 *sizes, size_t *offsets) {
+    ScvBool ok = sourceRead(source, sizes, sizeof(Int32) * header->stripeCount);
+    offsets[0] = 0;
+    for (int s = 0; s < header->stripeCount && ok; s++) {
+        ok = sizes[s] >= 0;
+        offsets[s + 1] = offsets[s] + sizes[s];
+    }
+    return ok;
+}
+
+ScvImage *readImageFromScvi(ByteSource *source) {
+    ScviHeader header;
+    if (!readScviHeader(source, &header)) {
+        return NULL;
+    }
+
+    const int stripeCount = header.stripeCount;
+    Int32 *sizes = (Int32 *)malloc(stripeCount * sizeof(Int32));
+    size_t *offsets = (size_t *)malloc((stripeCount + 1) * sizeof(size_t));
+    ScvBool ok = readScviStripeSizes(source, &header, sizes, offsets);
+
+    // Stripes are decoded straight from a memory source
+    ScvUByte *scratch = NULL;
+    const ScvUByte *data = NULL;
+    if (ok) {
+        scratch = source->file ? (ScvUByte *)malloc(MAX(offsets[stripeCount], 1)) : NULL;
+        data = sourceNext(source, scratch, offsets[stripeCount]);
+        // A byte of QOI codes makes at most QOI_RUN_MAX pixels, so the size is checked before allocating for it
+        ok = NULL != data && (double)header.width * header.height <= (double)QOI_RUN_MAX * offsets[stripeCount];
+    }
+
+    ScvImage *image = ok ? scvCreateImage(scvSize(header.width, header.height)) : NULL;
+    if (NULL != image) {
+        int s;
+#pragma omp parallel for schedule(dynamic) reduction(&& : ok)
+        for (s = 0; s < stripeCount; s++) {
+            const int y0 = s * header.stripeRows;
+            const int y1 = MIN(y0 + header.stripeRows, header.height);
+            ok = decodeScviStripe(data + offsets[s], sizes[s], image, y0, y1) && ok;
+        }
+        if (!ok) {
+            scvReleaseImage(image);
+            image = NULL;
+        }
+    }
+
+    free(scratch);
+    free(sizes);
+    free(offsets);
+    return image;
+}
+
+/**
+ * Case-insensitive check of the file name extension, e.g. ".bmp".
+ */
+ScvBool hasExtension(const char *filename, const char *ext) {
+    const size_t len = strlen(filename);
+    const size_t extLen = strlen(ext);
+    if (len < extLen) {
+        return SCV_FALSE;
+    }
+    for (size_t i = 0; i < extLen; i++) {
+        if (tolower((unsigned char)filename[len - extLen + i]) != tolower((unsigned char)ext[i])) {
+            return SCV_FALSE;
+        }
+    }
+    return SCV_TRUE;
+}
+
+ScvBool saveImageToFile(const ScvImage *image, const char *filename, int bitCount) {
+    FILE *fp = fopen(filename, "wb");
+    if (NULL == fp) {
+        return SCV_FALSE;
+    }
+
+    ByteSink sink = fileSink(fp);
+    ScvBool ok = bitCount ? saveImageToBmp(image, &sink, bitCount) : saveImageToScvi(image, &sink);
+    return 0 == fclose(fp) && ok;
+}
+
+/**
+ * Reads the pixels of rect, which is inside of the image, seeking to the rows it covers.
+ */
+ScvImage *readRegionFromBmp(ByteSource *source, const BmpLayout *layout, ScvRect rect) {
+    ScvImage *image = scvCreateImage(scvSize(rect.width, rect.height));
+    if (NULL == image) {
+        return NULL;
+    }
+    image->origin = layout->origin;
+    if (!readBmpRows(source, layout, rect.y, rect.y + rect.height, rect.x, image)) {
+        scvReleaseImage(image);
+        return NULL;
+    }
+    return image;
+}
+
+/**
+ * Decodes only the stripes covering the rows of rect, which is inside of the image.
+ */
+ScvImage *readRegionFromScvi(ByteSource *source, const ScviHeader *header, ScvRect rect) {
+    Int32 *sizes = (Int32 *)malloc(header->stripeCount * sizeof(Int32));
+    size_t *offsets = (size_t *)malloc((header->stripeCount + 1) * sizeof(size_t));
+    ScvBool ok = readScviStripeSizes(source, header, sizes, offsets);
+
+    const int s0 = rect.y / header->stripeRows;
+    const int s1 = (rect.y + rect.height - 1) / header->stripeRows + 1;
+    const int baseY = s0 * header->stripeRows;
+    ScvUByte *data = NULL;
+    if (ok) {
+        const size_t start = sourceTell(source) + offsets[s0];
+        data = (ScvUByte *)malloc(MAX(offsets[s1] - offsets[s0], 1));
+        ok = sourceSeek(source, start) && sourceRead(source, data, offsets[s1] - offsets[s0]);
+    }
+
+    ScvImage *image = NULL;
+    if (ok) {
+        const int stripesY1 = MIN(s1 * header->stripeRows, header->height);
+        ScvImage *stripes = scvCreateImage(scvSize(header->width, stripesY1 - baseY));
+        ok = NULL != stripes;
+        int s;
+#pragma omp parallel for schedule(dynamic) reduction(&& : ok)
+        for (s = s0; s < s1; s++) {
+            const int y0 = s * header->stripeRows;
+            const int y1 = MIN(y0 + header->stripeRows, header->height);
+            const ScvUByte *in = data + offsets[s] - offsets[s0];
+            ok = decodeScviStripe(in, sizes[s], stripes, y0 - baseY, y1 - baseY) && ok;
+        }
+        image = ok ? scvCreateImage(scvSize(rect.width, rect.height)) : NULL;
+        if (NULL != image) {
+            for (int y = 0; y < rect.height; y++) {
+                const ScvPixel *src = scvGetRowRef(stripes, rect.y - baseY + y) + rect.x;
+                memcpy(scvGetRowRef(image, y), src, sizeof(ScvPixel) * rect.width);
+            }
+        }
+        if (NULL != stripes) {
+            scvReleaseImage(stripes);
+        }
+    }
+
+    free(data);
+    free(sizes);
+    free(offsets);
+    return image;
+}
+
+/**
+ * Reads the headers of a BMP or SCVI file, leaving the source right after them.
+ */
+ScvBool readImageInfo(ByteSource *source, ScvBool scvi, ScvImageInfo *info, BmpLayout *layout, ScviHeader *header) {
+    if (scvi) {
+        if (!readScviHeader(source, header)) {
+            return SCV_FALSE;
+        }
+        info->width = header->width;
+        info->height = header->height;
+        info->bitCount = 24;
+        info->origin = 0;
         return SCV_TRUE;
     }
-    return SCV_FALSE;
+
+    if (!readBmpLayout(source, layout)) {
+        return SCV_FALSE;
+    }
+    info->width = layout->width;
+    info->height = layout->height;
+    info->bitCount = layout->bitCount;
+    info->origin = layout->origin;
+    return SCV_TRUE;
+}
+
+/**
+ * Box-averages rows into a downscaled image as they are read, factor by factor pixels per output pixel,
+ * the boxes at the right and bottom edges average the pixels they have. image is NULL if it cannot be allocated.
+ */
+typedef struct _BoxScaler {
+    int factor;
+    int width; // Source width
+    int rows; // Rows added since the last output row
+    Int64 *sums; // Channel sums for every output pixel
+    ScvImage *image;
+} BoxScaler;
+
+BoxScaler createBoxScaler(int width, int height, int factor) {
+    BoxScaler scaler;
+    scaler.factor = factor;
+    scaler.width = width;
+    scaler.rows = 0;
+    scaler.image = scvCreateImage(scvSize((width + factor - 1) / factor, (height + factor - 1) / factor));
+    scaler.sums = scaler.image ? (Int64 *)calloc((size_t)scaler.image->width * 3, sizeof(Int64)) : NULL;
+    return scaler;
 }
 
-ScvImage *readImageFromBmp(const char *filename) {
+void addBoxScalerRow(BoxScaler *scaler, const ScvUByte *row) {
+    Int64 *sums = scaler->sums;
+    for (int x = 0; x < scaler->width; x++) {
+        Int64 *sum = sums + x / scaler->factor * 3;
+        sum[0] += row[x * 3];
+        sum[1] += row[x * 3 + 1];
+        sum[2] += row[x * 3 + 2];
+    }
+    scaler->rows++;
+}
+
+// Stores the averages of the rows added so far as output row y, and starts the next one
+void flushBoxScaler(BoxScaler *scaler, int y) {
+    ScvUByte *dst = (ScvUByte *)scvGetRowRef(scaler->image, y);
+    for (int x = 0; x < scaler->image->width; x++) {
+        const Int64 cols = MIN(scaler->factor, scaler->width - x * scaler->factor);
+        const Int64 count = cols * scaler->rows;
+        for (int c = 0; c < 3; c++) {
+            dst[x * 3 + c] = (ScvUByte)((scaler->sums[x * 3 + c] + count / 2) / count);
+        }
+    }
+    memset(scaler->sums, 0, sizeof(Int64) * scaler->image->width * 3);
+    scaler->rows = 0;
+}
+
+ScvImage *readScaledFromBmp(ByteSource *source, const BmpLayout *layout, int factor) {
+    const int w = layout->width;
+    const int h = layout->height;
+    BoxScaler scaler = createBoxScaler(w, h, factor);
+    if (NULL == scaler.image) {
+        return NULL;
+    }
+    scaler.image->origin = layout->origin;
+
+    // Rows are read in file order, a box is complete at its last row in that order
+    ScvUByte *scratch = (ScvUByte *)malloc((size_t)layout->stride);
+    ScvUByte *row = (ScvUByte *)malloc((size_t)w * 3);
+    ScvBool ok = SCV_TRUE;
+    for (int i = 0; i < h && ok; i++) {
+        const int y = layout->origin ? h - 1 - i : i;
+        const ScvUByte *bmpRow = sourceNext(source, scratch, (size_t)layout->stride);
+        ok = NULL != bmpRow;
+        if (ok) {
+            convertBmpRow(bmpRow, row, 0, w, layout->bitCount, layout->palette);
+            addBoxScalerRow(&scaler, row);
+            const int lastOfBox = layout->origin ? 0 == y % factor : (y + 1) % factor == 0 || y == h - 1;
+            if (lastOfBox) {
+                flushBoxScaler(&scaler, y / factor);
+            }
+        }
+    }
+
+    free(scratch);
+    free(row);
+    free(scaler.sums);
+    if (!ok) {
+        scvReleaseImage(scaler.image);
+        return NULL;
+    }
+    return scaler.image;
+}
+
+ScvImage *readScaledFromScvi(ByteSource *source, const ScviHeader *header, int factor) {
+    Int32 *sizes = (Int32 *)malloc(header->stripeCount * sizeof(Int32));
+    size_t *offsets = (size_t *)malloc((header->stripeCount + 1) * sizeof(size_t));
+    ScvBool ok = readScviStripeSizes(source, header, sizes, offsets);
+
+    // One stripe at a time
+    BoxScaler scaler = createBoxScaler(header->width, header->height, factor);
+    ScvImage *stripe = scvCreateImage(scvSize(header->width, header->stripeRows));
+    ok = ok && NULL != scaler.image && NULL != stripe;
+    ScvUByte *data = NULL;
+    size_t capacity = 0;
+    for (int s = 0; s < header->stripeCount && ok; s++) {
+        if (NULL == data || (size_t)sizes[s] > capacity) {
+            capacity = MAX((size_t)sizes[s], 1);
+            data = (ScvUByte *)realloc(data, capacity);
+        }
+        const int y0 = s * header->stripeRows;
+        const int y1 = MIN(y0 + header->stripeRows, header->height);
+        ok = sourceRead(source, data, (size_t)sizes[s]) && decodeScviStripe(data, sizes[s], stripe, 0, y1 - y0);
+        for (int y = y0; y < y1 && ok; y++) {
+            addBoxScalerRow(&scaler, (const ScvUByte *)scvGetRowRef(stripe, y - y0));
+            if ((y + 1) % factor == 0 || y == header->height - 1) {
+                flushBoxScaler(&scaler, y / factor);
+            }
+        }
+    }
+
+    free(data);
+    free(sizes);
+    free(offsets);
+    free(scaler.sums);
+    if (NULL != stripe) {
+        scvReleaseImage(stripe);
+    }
+    if (!ok) {
+        if (NULL != scaler.image) {
+            scvReleaseImage(scaler.image);
+        }
+        return NULL;
+    }
+    return scaler.image;
+}
+
+#pragma mark - Export
+
+ScvImage *scvLoadImage(const char *filename) {
     FILE *fp = fopen(filename, "rb");
     if (NULL == fp) {
         return NULL;
     }
 
-    BitmapFileHeader fileHeader;
-    fread(&fileHeader, sizeof(BitmapFileHeader), 1, fp);
+    ByteSource source = fileSource(fp);
+    ScvImage *image = hasExtension(filename, ".scvi") ? readImageFromScvi(&source) : readImageFromBmp(&source);
+    fclose(fp);
+    return image;
+}
 
-    BitmapInfoHeader infoHeader;
-    fread(&infoHeader, sizeof(BitmapInfoHeader), 1, fp);
+ScvBool scvProbeImage(const char *filename, ScvImageInfo *info) {
+    FILE *fp = fopen(filename, "rb");
+    if (NULL == fp) {
+        return SCV_FALSE;
+    }
 
-    const int h = infoHeader.biHeight;
-    int origin = h > 0 ? 1 : 0;
-    ScvImage *image = scvCreateImage(scvSize(infoHeader.biWidth, h > 0 ? h : -h));
-    image->origin = origin;
+    ByteSource source = fileSource(fp);
+    BmpLayout layout;
+    ScviHeader header;
+    const ScvBool ok = readImageInfo(&source, hasExtension(filename, ".scvi"), info, &layout, &header);
+    fclose(fp);
+    return ok;
+}
 
-    fread(image->data, (size_t)infoHeader.biSizeImage, 1, fp);
+ScvImage *scvLoadImageRegion(const char *filename, ScvRect rect) {
+    FILE *fp = fopen(filename, "rb");
+    if (NULL == fp) {
+        return NULL;
+    }
 
+    ByteSource source = fileSource(fp);
+    const ScvBool scvi = hasExtension(filename, ".scvi");
+    ScvImageInfo info;
+    BmpLayout layout;
+    ScviHeader header;
+    ScvImage *image = NULL;
+    if (readImageInfo(&source, scvi, &info, &layout, &header)) {
+        // Clipped to the image
+        const int x0 = MAX(rect.x, 0), y0 = MAX(rect.y, 0);
+        const int x1 = MIN(rect.x + rect.width, info.width), y1 = MIN(rect.y + rect.height, info.height);
+        if (x1 > x0 && y1 > y0) {
+            const ScvRect clipped = scvRect(x0, y0, x1 - x0, y1 - y0);
+            image = scvi ? readRegionFromScvi(&source, &header, clipped) : readRegionFromBmp(&source, &layout, clipped);
+        }
+    }
     fclose(fp);
     return image;
 }
 
-#pragma mark - Export
+ScvImage *scvLoadImageScaled(const char *filename, int factor) {
+    if (factor <= 1) {
+        return scvLoadImage(filename);
+    }
 
-ScvImage *scvLoadImage(const char *filename) { return readImageFromBmp(filename); }
+    FILE *fp = fopen(filename, "rb");
+    if (NULL == fp) {
+        return NULL;
+    }
 
-ScvBool scvSaveImage(ScvImage *image, const char *filename) { return saveImageToBmp(image, filename); }
+    ByteSource source = fileSource(fp);
+    const ScvBool scvi = hasExtension(filename, ".scvi");
+    ScvImageInfo info;
+    BmpLayout layout;
+    ScviHeader header;
+    ScvImage *image = NULL;
+    if (readImageInfo(&source, scvi, &info, &layout, &header)) {
+        image = scvi ? readScaledFromScvi(&source, &header, factor) : readScaledFromBmp(&source, &layout, factor);
+    }
+    fclose(fp);
+    return image;
+}
+
+ScvBool scvSaveImage(ScvImage *image, const char *filename) {
+    return saveImageToFile(image, filename, hasExtension(filename, ".scvi") ? 0 : 24);
+}
+
+ScvBool scvSaveImageWithBitCount(ScvImage *image, const char *filename, int bitCount) {
+    return saveImageToFile(image, filename, bitCount);
+}
+
+ScvImage *scvDecodeImage(const void *buf, size_t len) {
+    ByteSource source = memorySource(buf, len);
+    if (len >= 4 && 0 == memcmp(buf, "SCVI", 4)) {
+        return readImageFromScvi(&source);
+    }
+    return readImageFromBmp(&source);
+}
+
+ScvImage *scvDecodeImageHeader(void *buf, size_t len) {
+    ByteSource source = memorySource(buf, len);
+    BitmapInfoHeader infoHeader;
+    unsigned int palette[256];
+    if (!readBmpHeader(&source, &infoHeader, palette) || 24 != infoHeader.biBitCount) {
+        return NULL;
+    }
+
+    const int w = infoHeader.biWidth;
+    const int h = infoHeader.biHeight > 0 ? infoHeader.biHeight : -infoHeader.biHeight;
+    const int stride = bmpStride(w, 24);
+    if ((size_t)stride * h > len - source.pos) {
+        return NULL;
+    }
+
+    ScvImage *image = (ScvImage *)malloc(sizeof(ScvImage));
+    image->width = w;
+    image->height = h;
+    image->widthBytes = stride;
+    image->origin = infoHeader.biHeight > 0 ? 1 : 0;
+    image->depth = SCV_DEPTH_8U;
+    image->data = (ScvUByte *)buf + source.pos;
+    return image;
+}
+
+void scvReleaseImageHeader(ScvImage *image) { free(image); }
+
+ScvBool scvEncodeImage(ScvImage *image, void **buf, size_t *len) {
+    ByteSink sink = memorySink(bmpFileSize(image, 24));
+    if (!saveImageToBmp(image, &sink, 24)) {
+        free(sink.data);
+        return SCV_FALSE;
+    }
+    *buf = sink.data;
+    *len = sink.size;
+    return SCV_TRUE;
+}
+
+ScvBool scvProcessBmpInBands(const char *srcFilename, const char *dstFilename, int bandRows, int halo,
+                             ScvBandFunc func, void *userData) {
+    if (bandRows <= 0 || halo < 0) {
+        return SCV_FALSE;
+    }
+
+    FILE *in = fopen(srcFilename, "rb");
+    if (NULL == in) {
+        return SCV_FALSE;
+    }
+    ByteSource source = fileSource(in);
+    BmpLayout layout;
+    FILE *out = readBmpLayout(&source, &layout) ? fopen(dstFilename, "wb") : NULL;
+    if (NULL == out) {
+        fclose(in);
+        return SCV_FALSE;
+    }
+
+    const int w = layout.width;
+    const int h = layout.height;
+    const int stride = bmpStride(w, 24);
+    ByteSink sink = fileSink(out);
+    ScvBool ok = writeBmpHeader(&sink, w, h, layout.origin, 24);
+
+    // Bands go in file order, bottom first for bottom-up files, so that both files are read and written forward
+    ScvUByte *row = (ScvUByte *)calloc((size_t)stride, 1);
+    const int bands = (h + bandRows - 1) / bandRows;
+    for (int i = 0; i < bands && ok; i++) {
+        const int band = layout.origin ? bands - 1 - i : i;
+        const int y0 = band * bandRows;
+        const int y1 = MIN(y0 + bandRows, h);
+        const int haloY0 = MAX(y0 - halo, 0);
+        const int haloY1 = MIN(y1 + halo, h);
+
+        ScvImage *src = scvCreateImage(scvSize(w, haloY1 - haloY0));
+        ScvImage *dst = src ? scvCreateImage(scvGetSize(src)) : NULL;
+        ok = NULL != dst && readBmpRows(&source, &layout, haloY0, haloY1, 0, src);
+        if (ok) {
+            func(src, dst, userData);
+        }
+        for (int j = 0; j < y1 - y0 && ok; j++) {
+            const int y = layout.origin ? y1 - 1 - j : y0 + j;
+            memcpy(row, scvGetRowRef(dst, y - haloY0), (size_t)w * 3);
+            ok = sinkWrite(&sink, row, (size_t)stride);
+        }
+        if (NULL != src) {
+            scvReleaseImage(src);
+        }
+        if (NULL != dst) {
+            scvReleaseImage(dst);
+        }
+    }
+
+    free(row);
+    fclose(in);
+    return 0 == fclose(out) && ok;
+}
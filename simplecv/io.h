@@ -27,8 +27,71 @@
 #ifndef SIMPLECV_IO_H
 #define SIMPLECV_IO_H
 
+/**
+ * Loads uncompressed 8-bit indexed, 24-bit and 32-bit BMP files,
+ * or SCVI files (a lossless QOI-based format for intermediate images) if the name ends with ".scvi".
+ * Returns NULL if the file cannot be read, the format is not supported or the image cannot be allocated.
+ */
 ScvImage *scvLoadImage(const char *filename);
 
+/**
+ * Reads only the headers of a file that scvLoadImage can load.
+ */
+ScvBool scvProbeImage(const char *filename, ScvImageInfo *info);
+
+/**
+ * Loads the pixels of rect (clipped to the image) from a file that scvLoadImage can load,
+ * reading only the rows of BMP files that rect covers and decoding only the SCVI stripes it covers.
+ * Returns NULL if the file cannot be read or rect is outside of the image.
+ */
+ScvImage *scvLoadImageRegion(const char *filename, ScvRect rect);
+
+/**
+ * Loads a file that scvLoadImage can load, downscaled by an integer factor:
+ * every output pixel is the average of a factor by factor box (partial at the right and bottom edges),
+ * so the image is ceil(width / factor) by ceil(height / factor). Rows are averaged as they are read,
+ * the full size image is never in memory.
+ */
+ScvImage *scvLoadImageScaled(const char *filename, int factor);
+
+/**
+ * Saves as SCVI if the name ends with ".scvi", otherwise as 24-bit BMP.
+ */
 ScvBool scvSaveImage(ScvImage *image, const char *filename);
 
+/**
+ * Saves as 8-bit gray (weighted average of the channels), 24-bit BGR or 32-bit BGRX BMP.
+ */
+ScvBool scvSaveImageWithBitCount(ScvImage *image, const char *filename, int bitCount);
+
+/**
+ * Decodes a BMP or SCVI file held in memory, the image owns a copy of the pixels.
+ * Returns NULL if the data is truncated, the format is not supported or the image cannot be allocated.
+ */
+ScvImage *scvDecodeImage(const void *buf, size_t len);
+
+/**
+ * Wraps the pixels of a 24-bit BMP file held in memory without copying,
+ * returns NULL for any other layout (use scvDecodeImage then).
+ * buf must outlive the image, which is released with scvReleaseImageHeader.
+ */
+ScvImage *scvDecodeImageHeader(void *buf, size_t len);
+
+void scvReleaseImageHeader(ScvImage *image);
+
+/**
+ * Encodes as a 24-bit BMP file into a new buffer, which the caller releases with free().
+ */
+ScvBool scvEncodeImage(ScvImage *image, void **buf, size_t *len);
+
+/**
+ * Runs func over a BMP file too large for memory and writes the result as a 24-bit BMP file
+ * of the same size and row order. The file is read in bands of bandRows rows, each handed to func
+ * with up to halo more rows above and below (fewer at the ends of the image), and only the rows of the band
+ * are kept from its result. Stencil operations give the same result as on the whole image if their radius
+ * is not larger than halo, e.g. 1 for scvSmooth. At most 2 bands are in memory at a time.
+ */
+ScvBool scvProcessBmpInBands(const char *srcFilename, const char *dstFilename, int bandRows, int halo,
+                             ScvBandFunc func, void *userData);
+
 #endif // SIMPLECV_IO_H
@@ -25,8 +25,14 @@
 #ifndef SIMPLECV_SCV_H
 #define SIMPLECV_SCV_H
 
+#include "analysis.h"
+#include "cache.h"
+#include "color.h"
 #include "core.h"
+#include "fft.h"
+#include "filter.h"
 #include "io.h"
+#include "stream.h"
 #include "types.h"
 
 #endif // SIMPLECV_SCV_H
@@ -0,0 +1,337 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <memory.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core.h"
+#include "stream.h"
+
+#pragma mark - Inner
+
+#define MAX(val1, val2) ((val1) > (val2) ? (val1) : (val2))
+
+#define Y4M_MAGIC "YUV4MPEG2"
+#define Y4M_FRAME "FRAME"
+#define Y4M_LINE_MAX 256
+
+// BT.601 limited range, fixed point with 10 fraction bits
+#define YUV_SHIFT 10
+#define YUV_Y 1192
+#define YUV_RV 1634
+#define YUV_GU (-401)
+#define YUV_GV (-832)
+#define YUV_BU 2066
+
+ScvUByte clampByte(int v) { return (ScvUByte)(v < 0 ? 0 : v > 255 ? 255 : v); }
+
+/**
+ * Reads one header line without the trailing '\n'.
+ */
+ScvBool readLine(FILE *fp, char *line, int size) {
+    int len = 0;
+    int c;
+    while ((c = fgetc(fp)) != EOF && c != '\n') {
+        if (len < size - 1) {
+            line[len++] = (char)c;
+        }
+    }
+    line[len] = '\0';
+    return c == '\n' ? SCV_TRUE : SCV_FALSE;
+}
+
+ScvBool parseY4MHeader(ScvFrameReader *reader) {
+    char line[Y4M_LINE_MAX];
+    if (!readLine((FILE *)reader->file, line, sizeof(line)) || strncmp(line, Y4M_MAGIC, strlen(Y4M_MAGIC)) != 0) {
+        return SCV_FALSE;
+    }
+
+    int w = 0, h = 0;
+    const char *colorspace = "420";
+    // Tags are separated by single spaces, each one is cut in place so the line stays reentrant
+    char *next = line + strlen(Y4M_MAGIC);
+    while ('\0' != *next) {
+        char *tag = next + strspn(next, " ");
+        next = tag + strcspn(tag, " ");
+        if ('\0' != *next) {
+            *next++ = '\0';
+        }
+        switch (tag[0]) {
+        case 'W':
+            w = atoi(tag + 1);
+            break;
+        case 'H':
+            h = atoi(tag + 1);
+            break;
+        case 'C':
+            colorspace = tag + 1;
+            break;
+        default:
+            // Frame rate, interlacing, aspect ratio and extensions don't matter here
+            break;
+        }
+    }
+    if (w <= 0 || h <= 0) {
+        return SCV_FALSE;
+    }
+
+    reader->size = scvSize(w, h);
+    if (0 == strcmp(colorspace, "420") || 0 == strcmp(colorspace, "420jpeg") || 0 == strcmp(colorspace, "420paldv") ||
+        0 == strcmp(colorspace, "420mpeg2")) {
+        // They only differ in chroma siting, 420p10 and the other deeper variants are rejected below
+        reader->chromaWidth = (w + 1) / 2;
+        reader->chromaHeight = (h + 1) / 2;
+    } else if (0 == strcmp(colorspace, "422")) {
+        reader->chromaWidth = (w + 1) / 2;
+        reader->chromaHeight = h;
+    } else if (0 == strcmp(colorspace, "444")) {
+        reader->chromaWidth = w;
+        reader->chromaHeight = h;
+    } else if (0 == strcmp(colorspace, "mono")) {
+        reader->chromaWidth = 0;
+        reader->chromaHeight = 0;
+    } else {
+        // High bit depth and alpha variants are not supported
+        return SCV_FALSE;
+    }
+    return SCV_TRUE;
+}
+
+void yuvToImage(const ScvFrameReader *reader, ScvImage *image) {
+    const int w = reader->size.width;
+    const int h = reader->size.height;
+    const int cw = reader->chromaWidth;
+    const int ch = reader->chromaHeight;
+    const ScvUByte *yPlane = reader->buffer;
+    const ScvUByte *uPlane = yPlane + w * h;
+    const ScvUByte *vPlane = uPlane + cw * ch;
+
+    for (int y = 0; y < h; y++) {
+        const ScvUByte *ys = yPlane + y * w;
+        ScvUByte *dst = (ScvUByte *)scvGetRowRef(image, y);
+        if (0 == cw) {
+            for (int x = 0; x < w; x++) {
+                dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = ys[x];
+            }
+            continue;
+        }
+
+        const int cy = ch == h ? y : y / 2;
+        const ScvUByte *us = uPlane + cy * cw;
+        const ScvUByte *vs = vPlane + cy * cw;
+        const int shiftX = cw == w ? 0 : 1;
+        for (int x = 0; x < w; x++) {
+            const int lum = YUV_Y * (ys[x] - 16) + (1 << (YUV_SHIFT - 1));
+            const int u = us[x >> shiftX] - 128;
+            const int v = vs[x >> shiftX] - 128;
+            dst[x * 3] = clampByte((lum + YUV_BU * u) >> YUV_SHIFT);
+            dst[x * 3 + 1] = clampByte((lum + YUV_GU * u + YUV_GV * v) >> YUV_SHIFT);
+            dst[x * 3 + 2] = clampByte((lum + YUV_RV * v) >> YUV_SHIFT);
+        }
+    }
+}
+
+void imageToYuv(const ScvImage *image, ScvUByte *buffer) {
+    const int w = image->width;
+    const int h = image->height;
+    ScvUByte *yPlane = buffer;
+    ScvUByte *uPlane = yPlane + w * h;
+    ScvUByte *vPlane = uPlane + w * h;
+
+    for (int y = 0; y < h; y++) {
+        const ScvUByte *src = (const ScvUByte *)scvGetRowRef(image, y);
+        ScvUByte *ys = yPlane + y * w;
+        ScvUByte *us = uPlane + y * w;
+        ScvUByte *vs = vPlane + y * w;
+        for (int x = 0; x < w; x++) {
+            const int b = src[x * 3];
+            const int g = src[x * 3 + 1];
+            const int r = src[x * 3 + 2];
+            ys[x] = (ScvUByte)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+            us[x] = (ScvUByte)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+            vs[x] = (ScvUByte)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+        }
+    }
+}
+
+#pragma mark - Export
+
+#pragma mark-- Make
+
+ScvFrameReader *scvCreateFrameReader(FILE *file, SCV_STREAM_FORMAT format, ScvSize size, int ringSize) {
+    ScvFrameReader *reader = (ScvFrameReader *)malloc(sizeof(ScvFrameReader));
+    memset(reader, 0, sizeof(ScvFrameReader));
+    reader->file = file;
+    reader->format = format;
+    reader->size = size;
+
+    switch (format) {
+    case SCV_STREAM_Y4M:
+        if (!parseY4MHeader(reader)) {
+            free(reader);
+            return NULL;
+        }
+        reader->frameBytes =
+            reader->size.width * reader->size.height + 2 * reader->chromaWidth * reader->chromaHeight;
+        break;
+    case SCV_STREAM_RAW_GRAY:
+        reader->frameBytes = size.width * size.height;
+        break;
+    case SCV_STREAM_RAW_BGR:
+    default:
+        reader->frameBytes = size.width * size.height * 3;
+        break;
+    }
+
+    reader->ringSize = MAX(ringSize, 1);
+    reader->ring = (ScvImage **)malloc(reader->ringSize * sizeof(ScvImage *));
+    for (int i = 0; i < reader->ringSize; i++) {
+        reader->ring[i] = scvCreateImage(reader->size);
+    }
+    reader->buffer = (ScvUByte *)malloc((size_t)reader->frameBytes);
+    return reader;
+}
+
+void scvReleaseFrameReader(ScvFrameReader *reader) {
+    for (int i = 0; i < reader->ringSize; i++) {
+        scvReleaseImage(reader->ring[i]);
+    }
+    free(reader->ring);
+    free(reader->buffer);
+    free(reader);
+}
+
+ScvFrameWriter *scvCreateFrameWriter(FILE *file, SCV_STREAM_FORMAT format, ScvSize size, int rateNum, int rateDen) {
+    ScvFrameWriter *writer = (ScvFrameWriter *)malloc(sizeof(ScvFrameWriter));
+    writer->file = file;
+    writer->format = format;
+    writer->size = size;
+    writer->frameCount = 0;
+    writer->frameBytes = size.width * size.height * (SCV_STREAM_RAW_GRAY == format ? 1 : 3);
+    writer->buffer = (ScvUByte *)malloc((size_t)writer->frameBytes);
+
+    if (SCV_STREAM_Y4M == format) {
+        if (rateNum <= 0 || rateDen <= 0) {
+            rateNum = 25;
+            rateDen = 1;
+        }
+        fprintf(file, Y4M_MAGIC " W%d H%d F%d:%d Ip A1:1 C444\n", size.width, size.height, rateNum, rateDen);
+    }
+    return writer;
+}
+
+void scvReleaseFrameWriter(ScvFrameWriter *writer) {
+    fflush((FILE *)writer->file);
+    free(writer->buffer);
+    free(writer);
+}
+
+#pragma mark-- Read and Write
+
+ScvImage *scvReadFrame(ScvFrameReader *reader) {
+    FILE *fp = (FILE *)reader->file;
+    const int w = reader->size.width;
+    const int h = reader->size.height;
+
+    if (SCV_STREAM_Y4M == reader->format) {
+        char line[Y4M_LINE_MAX];
+        if (!readLine(fp, line, sizeof(line)) || strncmp(line, Y4M_FRAME, strlen(Y4M_FRAME)) != 0) {
+            return NULL;
+        }
+    }
+
+    ScvImage *image = reader->ring[reader->ringNext];
+
+    // BGR rows are read straight into the image
+    if (SCV_STREAM_RAW_BGR == reader->format) {
+        for (int y = 0; y < h; y++) {
+            if (fread(scvGetRowRef(image, y), (size_t)w * 3, 1, fp) != 1) {
+                return NULL;
+            }
+        }
+    } else {
+        if (fread(reader->buffer, (size_t)reader->frameBytes, 1, fp) != 1) {
+            return NULL;
+        }
+
+        switch (reader->format) {
+        case SCV_STREAM_Y4M:
+            yuvToImage(reader, image);
+            break;
+        case SCV_STREAM_RAW_GRAY:
+            for (int y = 0; y < h; y++) {
+                const ScvUByte *src = reader->buffer + y * w;
+                ScvUByte *dst = (ScvUByte *)scvGetRowRef(image, y);
+                for (int x = 0; x < w; x++) {
+                    dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = src[x];
+                }
+            }
+            break;
+        case SCV_STREAM_RAW_BGR:
+        default:
+            for (int y = 0; y < h; y++) {
+                memcpy(scvGetRowRef(image, y), reader->buffer + y * w * 3, (size_t)w * 3);
+            }
+            break;
+        }
+    }
+
+    reader->ringNext = (reader->ringNext + 1) % reader->ringSize;
+    reader->frameCount++;
+    return image;
+}
+
+ScvBool scvWriteFrame(ScvFrameWriter *writer, const ScvImage *image) {
+    FILE *fp = (FILE *)writer->file;
+    const int w = writer->size.width;
+    const int h = writer->size.height;
+    if (image->width != w || image->height != h || SCV_DEPTH_8U != image->depth) {
+        return SCV_FALSE;
+    }
+
+    switch (writer->format) {
+    case SCV_STREAM_Y4M:
+        imageToYuv(image, writer->buffer);
+        fputs(Y4M_FRAME "\n", fp);
+        break;
+    case SCV_STREAM_RAW_GRAY:
+        for (int y = 0; y < h; y++) {
+            const ScvUByte *src = (const ScvUByte *)scvGetRowRef(image, y);
+            ScvUByte *dst = writer->buffer + y * w;
+            for (int x = 0; x < w; x++) {
+                dst[x] = src[x * 3 + 2];
+            }
+        }
+        break;
+    case SCV_STREAM_RAW_BGR:
+    default:
+        for (int y = 0; y < h; y++) {
+            memcpy(writer->buffer + y * w * 3, scvGetRowRef(image, y), (size_t)w * 3);
+        }
+        break;
+    }
+
+    if (fwrite(writer->buffer, (size_t)writer->frameBytes, 1, fp) != 1) {
+        return SCV_FALSE;
+    }
+    writer->frameCount++;
+    return SCV_TRUE;
+}
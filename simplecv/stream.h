@@ -0,0 +1,64 @@
+//
+// Copyright (c) 2016 Richard Chien
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+
+#include "types.h"
+
+#ifndef SIMPLECV_STREAM_H
+#define SIMPLECV_STREAM_H
+
+#pragma mark - Make
+
+/**
+ * Reads a frame sequence from an opened file or pipe, e.g. stdin or the result of popen.
+ * The size is taken from the header for Y4M, and must be given for raw formats.
+ * ringSize images are allocated up front and recycled for every frame.
+ * Returns NULL if the Y4M header is invalid or unsupported.
+ */
+ScvFrameReader *scvCreateFrameReader(FILE *file, SCV_STREAM_FORMAT format, ScvSize size, int ringSize);
+
+// The file is not closed.
+void scvReleaseFrameReader(ScvFrameReader *reader);
+
+/**
+ * Writes a frame sequence to an opened file or pipe, the Y4M header is written immediately.
+ * The frame rate is rateNum / rateDen frames per second, e.g. 30000 / 1001, and only goes into the Y4M header.
+ * 25 fps is written if either is not positive.
+ */
+ScvFrameWriter *scvCreateFrameWriter(FILE *file, SCV_STREAM_FORMAT format, ScvSize size, int rateNum, int rateDen);
+
+// The file is not closed but flushed.
+void scvReleaseFrameWriter(ScvFrameWriter *writer);
+
+#pragma mark - Read and Write
+
+/**
+ * Reads the next frame into the next image of the ring.
+ * Returns NULL at the end of the stream.
+ */
+ScvImage *scvReadFrame(ScvFrameReader *reader);
+
+/**
+ * The image must have the size of the writer, gray formats take the red channel like scvCanny.
+ */
+ScvBool scvWriteFrame(ScvFrameWriter *writer, const ScvImage *image);
+
+#endif // SIMPLECV_STREAM_H
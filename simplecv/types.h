@@ -25,6 +25,8 @@
 #ifndef SIMPLECV_TYPES_H
 #define SIMPLECV_TYPES_H
 
+#include <stddef.h>
+
 #ifndef SCV_INLINE
 #if defined __cplusplus
 #define SCV_INLINE inline
@@ -68,6 +70,22 @@ SCV_INLINE ScvSize scvSize(int width, int height) {
     return size;
 }
 
+typedef struct _ScvRect {
+    int x;
+    int y;
+    int width;
+    int height;
+} ScvRect;
+
+SCV_INLINE ScvRect scvRect(int x, int y, int width, int height) {
+    ScvRect rect;
+    rect.x = x;
+    rect.y = y;
+    rect.width = width;
+    rect.height = height;
+    return rect;
+}
+
 typedef struct _ScvMat {
     int rows;
     int cols;
@@ -106,12 +124,23 @@ SCV_INLINE ScvPixel scvPixelAll(int bgr) {
     return pixel;
 }
 
+/**
+ * Type of the channel values of an image.
+ * Integer values cover their whole range, float values are 0.0 to 1.0 for black to white.
+ */
+typedef enum _SCV_DEPTH {
+    SCV_DEPTH_8U = 0,
+    SCV_DEPTH_16S,
+    SCV_DEPTH_16U,
+    SCV_DEPTH_32F
+} SCV_DEPTH;
+
 typedef struct _ScvImage {
     // The logical origin point if left-top,
 
     int width; // Real width in pixel
     int height;
-    int widthBytes; // Bmp width in byte (a multiple of 4)
+    int widthBytes; // Row stride in byte, a multiple of 4 (of scvGetImageAlignment for created images)
 
     /**
      * The real origin of image,
@@ -121,7 +150,16 @@ typedef struct _ScvImage {
     int origin;
 
     /**
-     * Pixel data, e.g. a 2*2 image: [b g r b g r 0 0 b g r b g r 0 0],
+     * Type of the 3 channels of every pixel.
+     * Besides making and copying, only scvConvertImage, scvSmooth, scvAddWeighed, the histogram functions,
+     * the geometric ones (scvWarpAffine, scvWarpPerspective, scvRemap, scvFlip, scvTranspose, scvRotate90),
+     * scvFilter2D, scvBilateralFilter and scvFFTImage / scvInverseFFTImage support depths other than SCV_DEPTH_8U.
+     * The rest work on ScvPixel: the pixel accessors assume SCV_DEPTH_8U, the operations do nothing for other depths.
+     */
+    SCV_DEPTH depth;
+
+    /**
+     * Pixel data, e.g. a 2*2 image with 4-byte alignment: [b g r b g r 0 0 b g r b g r 0 0],
      * the tailing 0 in every line is for aligning
      */
     void *data;
@@ -148,8 +186,211 @@ SCV_INLINE ScvHistogram scvHistogram(SCV_GRAYING_TYPE grayingType, int val[256])
     return histogram;
 }
 
+typedef struct _ScvComponent {
+    int area; // Pixel count
+    ScvRect bound; // Bounding box
+    float cx; // Centroid
+    float cy;
+} ScvComponent;
+
+typedef struct _ScvLabels {
+    int width;
+    int height;
+
+    /**
+     * Label of every pixel, row by row from the logical top,
+     * 0 for background, 1 ~ count for components.
+     */
+    int *label;
+
+    int count; // Component count, excluding background
+
+    /**
+     * Statistics indexed by label, i.e. components[0] is the background,
+     * components[1] ~ components[count] are the connected components.
+     */
+    ScvComponent *components;
+    int capacity;
+} ScvLabels;
+
+/**
+ * A line x * cos(theta) + y * sin(theta) = rho in logical coordinates, theta in [0, PI).
+ */
+typedef struct _ScvLine {
+    float rho;
+    float theta;
+    int votes;
+} ScvLine;
+
+typedef struct _ScvLineSegment {
+    ScvPoint start;
+    ScvPoint end;
+} ScvLineSegment;
+
+typedef struct _ScvDirtyMap {
+    int width; // Image size
+    int height;
+    int blockSize;
+    int cols; // Block grid size
+    int rows;
+    ScvUByte *dirty; // A flag for every block, row by row from the logical top
+} ScvDirtyMap;
+
+/**
+ * Intermediate results of scvCanny kept between frames by scvCannyDirty.
+ */
+typedef struct _ScvCannyState {
+    int width;
+    int height;
+    ScvImage *filtered; // Gaussian filtered image
+    short *P; // Gradient in x and y, y pointing upwards
+    short *Q;
+    short *M; // Gradient magnitude
+    ScvUByte *N; // 128 for the candidates surviving non-maximum suppression
+    ScvUByte *E; // Traced edges
+    int hist[1024]; // Magnitude histogram of the candidates
+} ScvCannyState;
+
+/**
+ * Where every destination pixel is sampled from, built once by scvBuildMap and applied by scvRemap.
+ * Coordinates are fixed point, the top-left of the 2x2 bilinear taps and SCV_MAP_BITS fraction bits of x and y,
+ * with pixel centers at integer + 0.5 like the warps. Sources may be up to 32000 pixels wide and high.
+ */
+#define SCV_MAP_BITS 5
+
+typedef struct _ScvMap {
+    int width; // Destination size
+    int height;
+    short *coords; // x and y pairs, row by row from the logical top
+    unsigned short *fractions; // y fraction << SCV_MAP_BITS | x fraction
+} ScvMap;
+
+/**
+ * Maps the center of a destination pixel to the source, for scvBuildMapWithFunc, e.g. a lens distortion model.
+ */
+typedef void (*ScvMapFunc)(float dstX, float dstY, float *srcX, float *srcY, void *userData);
+
+/**
+ * What scvProbeImage reads from the headers of an image file.
+ */
+typedef struct _ScvImageInfo {
+    int width;
+    int height;
+    int bitCount; // 8, 24 or 32 for BMP, 24 for SCVI
+    int origin; // 1 if the rows are stored bottom-up
+} ScvImageInfo;
+
+/**
+ * An operation run by scvProcessBmpInBands on every band of rows, from src to dst of the same size.
+ */
+typedef void (*ScvBandFunc)(const ScvImage *src, ScvImage *dst, void *userData);
+
 typedef enum _SCV_FLIP_TYPE { SCV_FLIP_HORIZONTAL, SCV_FLIP_VERTICAL } SCV_FLIP_TYPE;
 
+typedef enum _SCV_INTERPOLATION { SCV_INTER_NEAREST, SCV_INTER_LINEAR } SCV_INTERPOLATION;
+
 typedef enum _SCV_SMOOTH_TYPE { SCV_SMOOTH_AVG, SCV_SMOOTH_MEDIAN, SCV_SMOOTH_GAUSSIAN } SCV_SMOOTH_TYPE;
 
+typedef enum _SCV_SOBEL_TYPE { SCV_SOBEL_3, SCV_SOBEL_5, SCV_SOBEL_SCHARR } SCV_SOBEL_TYPE;
+
+typedef enum _SCV_MORPH_TYPE {
+    SCV_MORPH_ERODE,
+    SCV_MORPH_DILATE,
+    SCV_MORPH_OPEN,
+    SCV_MORPH_CLOSE,
+    SCV_MORPH_GRADIENT
+} SCV_MORPH_TYPE;
+
+/**
+ * SCV_MATCH_SSD is the sum of squared differences, lower is better.
+ * SCV_MATCH_NCC is the zero-mean normalized cross-correlation in [-1, 1], higher is better.
+ */
+typedef enum _SCV_MATCH_TYPE { SCV_MATCH_SSD, SCV_MATCH_NCC } SCV_MATCH_TYPE;
+
+/**
+ * The converted channels are stored to b, g and r of the pixels in order, e.g. H, S, V to b, g, r.
+ * HSV: H is 0 ~ 179 (degrees / 2), S and V are 0 ~ 255.
+ * YCbCr: full range JPEG (BT.601), Cb and Cr are offset by 128.
+ * Lab: sRGB with D65 white, L is scaled to 0 ~ 255, a and b are offset by 128.
+ */
+typedef enum _SCV_COLOR_CONVERSION {
+    SCV_COLOR_BGR2HSV,
+    SCV_COLOR_HSV2BGR,
+    SCV_COLOR_BGR2YCBCR,
+    SCV_COLOR_YCBCR2BGR,
+    SCV_COLOR_BGR2LAB,
+    SCV_COLOR_LAB2BGR
+} SCV_COLOR_CONVERSION;
+
+typedef enum _SCV_STREAM_FORMAT {
+    SCV_STREAM_RAW_BGR, // Headerless 24-bit BGR frames
+    SCV_STREAM_RAW_GRAY, // Headerless 8-bit gray frames
+    SCV_STREAM_Y4M // YUV4MPEG2, 4:2:0, 4:2:2, 4:4:4 or mono when reading, 4:4:4 when writing
+} SCV_STREAM_FORMAT;
+
+typedef struct _ScvFrameReader {
+    void *file; // The FILE * being read, owned by the caller
+    SCV_STREAM_FORMAT format;
+    ScvSize size;
+    int chromaWidth; // Y4M chroma plane size, 0 for mono
+    int chromaHeight;
+
+    /**
+     * Frames are decoded into a fixed ring of images, so an image returned by
+     * scvReadFrame stays valid until ringSize more frames are read.
+     */
+    int ringSize;
+    ScvImage **ring;
+    int ringNext;
+
+    ScvUByte *buffer; // One raw frame
+    int frameBytes;
+    int frameCount;
+} ScvFrameReader;
+
+typedef struct _ScvFrameWriter {
+    void *file; // The FILE * being written, owned by the caller
+    SCV_STREAM_FORMAT format;
+    ScvSize size;
+    ScvUByte *buffer; // One raw frame
+    int frameBytes;
+    int frameCount;
+} ScvFrameWriter;
+
+typedef struct _ScvCacheEntry {
+    unsigned long long imageHash; // Hash of the source image
+    unsigned long long paramsHash; // Hash of the other arguments
+    int op;
+    ScvImage *result;
+    size_t bytes;
+    struct _ScvCacheEntry *prev; // Neighbors in the LRU list
+    struct _ScvCacheEntry *next;
+    struct _ScvCacheEntry *chain; // Next entry in the same bucket
+} ScvCacheEntry;
+
+typedef struct _ScvCache {
+    size_t budget; // Max bytes of cached pixel data
+    size_t used;
+    int count;
+    int bucketCount;
+    ScvCacheEntry **buckets;
+    ScvCacheEntry *head; // Most recently used
+    ScvCacheEntry *tail; // Least recently used
+    int hits;
+    int misses;
+} ScvCache;
+
+/**
+ * Plan of a real 2-D FFT of rows * cols values, see fft.h.
+ * The spectrum keeps the cols / 2 + 1 non-redundant columns,
+ * as a rows * (2 * specCols) matrix of interleaved real and imaginary parts.
+ */
+typedef struct _ScvFFTPlan {
+    int rows;
+    int cols;
+    int specCols;
+    void *rowPlan; // Complex plans of the row and column lengths, twiddles are precomputed
+    void *colPlan;
+} ScvFFTPlan;
+
 #endif // SIMPLECV_TYPES_H